@@ -1,12 +1,19 @@
 /**
  * VELO - Pure JS Refactoring
  * Handles image compression, state management, and UI updates locally.
+ * The per-image work goes through the headless library (velo.js); this file adds scheduling, the worker
+ * pool with crash recovery, the result store and the UI on top.
  */
 
+import { createVelo, createWorkerPool, outputName, zipResults } from './velo.js';
+
 const state = {
     files: [], // Array of file objects { id, name, originalFile, originalUrl, compressedBlob, compressedUrl, quality, format, size, compressedSize, savings }
     selectedFileId: null,
     globalFormat: 'jpeg',
+    globalEffort: 'fast', // Upper bound for the per-image effort, see EFFORT
+    timeBudget: 0, // ms per batch, 0 = unlimited
+    keepResults: false, // Opt-in: results persist in the store (store.js), localStorage 'velo.store' = '1'
     showingOriginal: false,
     zoom: { scale: 1, x: 0, y: 0, isDragging: false, startX: 0, startY: 0 }
 };
@@ -14,6 +21,114 @@ const state = {
 // DOM Elements cache
 const els = {};
 
+// Encode queue: files waiting to be (re)compressed, dispatched by priority
+const encodeQueue = {
+    pending: [],        // fileEntries waiting for a slot
+    running: 0,
+    concurrency: 2,     // one decoding while the other encodes
+    idleHandle: null    // pending requestIdleCallback for background work
+};
+
+// Encoder workers (velo.js createWorkerPool), null when workers are unavailable: encodes then run on the main thread
+let workerPool = null;
+
+// Library engine for processFile, see initWorkerPool(): results come from and go to the result store
+// (store.js) once the user has opted into keeping them
+let engine = null;
+const resultCache = {
+    get: (file, settings) => state.keepResults ? manifestGet(file, settings) : null,
+    put: (file, settings, result) => state.keepResults ? manifestPut(file, settings, result) : undefined
+};
+
+// Lazily loaded scripts: src -> load promise, see loadScript()
+const loadedScripts = new Map();
+
+// Output formats loaded so far: format -> Promise<supported>, see ensureCodec()
+const codecs = new Map();
+
+// Runtime capabilities, see detectCapabilities()
+const caps = {
+    workers: false,                                     // Worker + OffscreenCanvas 2D + createImageBitmap
+    encoders: { jpeg: true, webp: true, png: true }    // Output formats the browser can really encode, refined by ensureCodec()
+};
+
+// Pipeline statistics for the performance HUD, see recordJob()
+const perf = {
+    hudVisible: false,
+    hudTimer: null,
+    firstJobAt: 0,          // performance.now() of the first job, 0 before
+    lastJobAt: 0,
+    completed: 0,           // Jobs encoded; store hits only count in manifestHits
+    pixels: 0,
+    bytesIn: 0,
+    bytesOut: 0,
+    uiMs: 0,                // Duration of the last updateUI()
+    longTasks: [],          // { start, duration }
+    recent: [],             // Last finished jobs: { name, pixels, effort, timings }
+    mainPool: null,         // canvasPoolStats() of the main thread once it encoded (read live: it trims when idle); the workers' are in workerPool.stats()
+    manifestHits: 0,        // Jobs answered from the result store
+    apiRejected: 0,         // Batch API submissions shed by admission control
+    histograms: {}          // 'stage:format' -> latency histogram (see codec.js), scraped via the service worker's /metrics
+};
+
+// Chrome Trace Event recording, enabled with ?trace=1 or localStorage 'velo.trace' = '1'.
+// Events go to a fixed-size ring buffer: the oldest are overwritten on long sessions.
+const TRACE_CAPACITY = 100000;
+const trace = {
+    enabled: false,
+    events: [],
+    next: 0     // Ring buffer write position
+};
+
+
+// Concurrent file reads/writes for header sniffing and folder export
+const IO_CONCURRENCY = 8;
+
+// Watch folder mode: new or changed images in `input` are optimized into the same relative path in `output`
+const WATCH_POLL_MS = 400;       // Polling interval without FileSystemObserver, and delay of a confirming rescan with it
+const WATCH_KEEP_WRITTEN = 50;  // Mirrored files kept in the list, older ones are dropped with their blobs
+const watch = {
+    input: null,        // FileSystemDirectoryHandle
+    output: null,
+    seen: new Map(),    // Relative path -> { size, lastModified, queued }
+    timer: null,        // Poll interval, only without an observer
+    confirm: null,      // Pending confirming rescan, only with an observer
+    observer: null,
+    scanning: false,
+    rescan: false       // A change was reported during a scan
+};
+
+// Batch job API for other windows (e.g. a CMS that embeds or opens VELO), see onApiMessage()
+const API_MAX_BYTES = 256 * 1024 * 1024; // Input + output bytes held for API jobs; larger submissions are shed
+const API_RESULT_TTL_MS = 10 * 60 * 1000; // Finished jobs not fetched within this are dropped
+const API_SWEEP_MS = 5000;                // How often closed submitters and expired jobs are looked for
+const API_MIN_RETRY_MS = 1000;            // Floor for retryAfter, so a shed client never spins
+const api = {
+    origins: [location.origin], // Allowed senders, extended with ?api=<origin>[,<origin>]
+    jobs: new Map(),            // job id -> { id, source, origin, files, done, failed, bytes, finishedAt }
+    nextId: 1,
+    bytes: 0,                   // Held by all jobs not fetched yet
+    sweep: null                 // Interval handle while jobs are held
+};
+
+// Finished jobs waiting for the next frame's updateUI, see scheduleRender()
+const render = { frame: null, files: [] };
+
+// Queue priorities: lower runs first
+const PRIORITY = { SELECTED: 0, VISIBLE: 1, BACKGROUND: 2 };
+
+// Effort tiers, cheapest first (see encodeImage in codec.js). msPerMP is a running estimate refined after every encode.
+// Balanced only adds a size comparison to fast, so the two cost about the same: in practice a time
+// budget steps max down to balanced, and falls back to fast only when even that would not fit.
+const EFFORT = {
+    fast: { rank: 0, msPerMP: 15 },
+    balanced: { rank: 1, msPerMP: 16 },
+    max: { rank: 2, msPerMP: 45 }
+};
+
+// Current batch: starts when the queue leaves idle, ends when it drains
+const batch = { active: false, deadline: 0 };
+
 document.addEventListener('DOMContentLoaded', () => {
     // Cache elements by ID
     const ids = [
@@ -22,8 +137,10 @@ document.addEventListener('DOMContentLoaded', () => {
         'zoomFrame', 'veloContainer', 'filesCountLabel', 'privacyDate',
         'btnAbout', 'modalAbout', 'backdropAbout', 'btnCloseAbout',
         'modalPrivacy', 'backdropPrivacy', 'btnClosePrivacy', 'linkPrivacy',
-        'btnSelectImages', 'btnAddImg', 'globalFormat', 'btnClear', 'btnZip',
-        'btnShowOriginal', 'btnShowOptimized', 'btnResetZoom'
+        'btnSelectImages', 'btnAddImg', 'globalFormat', 'globalEffort', 'globalBudget', 'btnClear', 'btnZip', 'btnSaveFolder', 'btnWatch',
+        'btnShowOriginal', 'btnShowOptimized', 'btnResetZoom',
+        'storeEnabled', 'storeStatsLabel', 'btnStoreExport', 'btnStoreImport', 'btnStoreClear', 'storeImportInput',
+        'btnPerf', 'perfHud', 'perfHudBody', 'btnPerfExport', 'btnTraceExport'
     ];
     
     ids.forEach(id => {
@@ -36,7 +153,23 @@ document.addEventListener('DOMContentLoaded', () => {
         els.privacyDate.textContent = new Date().toLocaleDateString('en-US', { month: 'long', day: '2-digit', year: 'numeric' });
     }
 
+    // Effort and budget can be preset from the URL for scripted runs (?effort=max&budget=5000)
+    const params = new URLSearchParams(location.search);
+    if (EFFORT[params.get('effort')]) state.globalEffort = params.get('effort');
+    trace.enabled = params.get('trace') === '1' || localStorage.getItem('velo.trace') === '1';
+    state.keepResults = localStorage.getItem('velo.store') === '1';
+    if (params.get('budget')) state.timeBudget = Math.max(0, parseInt(params.get('budget')) || 0);
+    if (els.globalEffort) els.globalEffort.value = state.globalEffort;
+    if (els.globalBudget) els.globalBudget.value = String(state.timeBudget);
+    if (params.get('api')) api.origins.push(...params.get('api').split(','));
+
+    detectCapabilities();
+    initWorkerPool();
     setupEventListeners();
+    ensureCodec(state.globalFormat).then(prefetchCodecs);
+    registerServiceWorker();
+    observeLongTasks();
+    window.addEventListener('message', onApiMessage);
 });
 
 function setupEventListeners() {
@@ -47,10 +180,45 @@ function setupEventListeners() {
     };
 
     // About Modal
-    if(els.btnAbout) els.btnAbout.onclick = () => toggle('modalAbout', true);
+    if(els.btnAbout) els.btnAbout.onclick = () => { toggle('modalAbout', true); renderStoreStats(); };
     if(els.backdropAbout) els.backdropAbout.onclick = () => toggle('modalAbout', false);
     if(els.btnCloseAbout) els.btnCloseAbout.onclick = () => toggle('modalAbout', false);
 
+    // Result Store
+    if(els.btnStoreExport) els.btnStoreExport.onclick = async () => {
+        await loadScript('assets/js/jszip.min.js');
+        const content = await exportStore();
+        const a = document.createElement('a');
+        a.href = URL.createObjectURL(content);
+        a.download = "velo-store.zip";
+        document.body.appendChild(a);
+        a.click();
+        document.body.removeChild(a);
+    };
+    if(els.btnStoreImport) els.btnStoreImport.onclick = () => els.storeImportInput.click();
+    if(els.storeImportInput) els.storeImportInput.onchange = async (e) => {
+        if (!e.target.files[0] || !state.keepResults) return;
+        await loadScript('assets/js/jszip.min.js');
+        await importStore(e.target.files[0]);
+        e.target.value = '';
+        renderStoreStats();
+    };
+    if(els.btnStoreClear) els.btnStoreClear.onclick = async () => { await clearStore(); renderStoreStats(); };
+    if(els.storeEnabled) {
+        els.storeEnabled.checked = state.keepResults;
+        // Turning it off also forgets what was kept, as the Privacy Policy promises
+        els.storeEnabled.onchange = async (e) => {
+            state.keepResults = e.target.checked;
+            if (state.keepResults) {
+                localStorage.setItem('velo.store', '1');
+            } else {
+                localStorage.removeItem('velo.store');
+                await clearStore();
+            }
+            renderStoreStats();
+        };
+    }
+
     // Privacy Modal
     if(els.linkPrivacy) els.linkPrivacy.onclick = (e) => { e.preventDefault(); toggle('modalPrivacy', true); };
     if(els.backdropPrivacy) els.backdropPrivacy.onclick = () => toggle('modalPrivacy', false);
@@ -78,19 +246,50 @@ function setupEventListeners() {
     // Global Actions
     if(els.btnClear) els.btnClear.onclick = clearAll;
     if(els.btnZip) els.btnZip.onclick = downloadZip;
+    if(els.btnSaveFolder) {
+        els.btnSaveFolder.classList.toggle('d-none', !window.showDirectoryPicker);
+        els.btnSaveFolder.onclick = saveToFolder;
+    }
+    if(els.btnWatch) {
+        els.btnWatch.classList.toggle('d-none', !window.showDirectoryPicker);
+        els.btnWatch.onclick = () => watch.input ? stopWatch() : startWatch();
+    }
     if(els.globalFormat) els.globalFormat.onchange = (e) => {
         state.globalFormat = e.target.value;
+        ensureCodec(state.globalFormat);
+        // API jobs keep the options they were submitted with
         state.files.forEach(f => {
+            if (f.apiJob) return;
             f.format = state.globalFormat;
-            processFile(f);
+            scheduleProcess(f);
         });
     };
+    if(els.globalEffort) els.globalEffort.onchange = (e) => {
+        state.globalEffort = e.target.value;
+        state.files.forEach(f => { if (!f.apiJob) scheduleProcess(f); });
+    };
+    if(els.globalBudget) els.globalBudget.onchange = (e) => {
+        state.timeBudget = parseInt(e.target.value) || 0;
+    };
 
     // Zoom Controls
     if(els.btnShowOriginal) els.btnShowOriginal.onclick = () => setPreviewMode(true);
     if(els.btnShowOptimized) els.btnShowOptimized.onclick = () => setPreviewMode(false);
     if(els.btnResetZoom) els.btnResetZoom.onclick = resetZoom;
 
+    // Performance HUD
+    if(els.btnPerf) els.btnPerf.onclick = () => togglePerfHud(!perf.hudVisible);
+    if(els.btnPerfExport) els.btnPerfExport.onclick = exportPerf;
+    if(els.btnTraceExport) {
+        els.btnTraceExport.classList.toggle('d-none', !trace.enabled);
+        els.btnTraceExport.onclick = exportTrace;
+    }
+    if(els.perfHud) {
+        // Scrolling and selecting inside the HUD must not pan or zoom the preview
+        els.perfHud.onmousedown = (e) => e.stopPropagation();
+        els.perfHud.onwheel = (e) => e.stopPropagation();
+    }
+
     // Zoom Interaction (Pan & Wheel)
     if(els.veloContainer) {
         els.veloContainer.onwheel = handleWheel;
@@ -102,65 +301,586 @@ function setupEventListeners() {
 
 // --- File Handling ---
 
+function createFileEntry(file) {
+    return {
+        id: Math.random().toString(36).substr(2, 9),
+        name: file.name,
+        originalFile: file,
+        originalUrl: URL.createObjectURL(file),
+        size: file.size,
+        quality: 75,
+        format: state.globalFormat,
+        compressedBlob: null,
+        compressedUrl: null,
+        compressedSize: 0,
+        savings: 0,
+        pixels: 0, // From the file header, or the first decode; used for shortest-job-first ordering
+        watchPath: null // Relative path inside the watched folder, see startWatch()
+    };
+}
+
 async function handleFiles(fileList) {
     const newFiles = Array.from(fileList).filter(f => f.type.startsWith('image/'));
     if (newFiles.length === 0) return;
 
+    const added = [];
     for (const file of newFiles) {
         // Avoid duplicates by name
         if (state.files.some(f => f.name === file.name)) continue;
 
-        const fileEntry = {
-            id: Math.random().toString(36).substr(2, 9),
-            name: file.name,
-            originalFile: file,
-            originalUrl: URL.createObjectURL(file),
-            size: file.size,
-            quality: 75,
-            format: state.globalFormat,
-            compressedBlob: null,
-            compressedUrl: null,
-            compressedSize: 0,
-            savings: 0
-        };
-
+        const fileEntry = createFileEntry(file);
         state.files.push(fileEntry);
+        added.push(fileEntry);
         if (!state.selectedFileId) state.selectedFileId = fileEntry.id;
-        
-        // Process (Compress)
-        await processFile(fileEntry);
     }
 
     if(els.fileInput) els.fileInput.value = ''; // Reset input
     updateUI();
+
+    // The file on screen can't wait for the other headers; it is the first job either way
+    const selected = added.find(f => f.id === state.selectedFileId);
+    if (selected) scheduleProcess(selected);
+
+    // Header read-ahead gives exact job sizes before anything is decoded. Each file is queued as
+    // soon as its own header is in, so a slow read doesn't hold back the rest of the drop.
+    await mapLimit(added.filter(f => f !== selected), IO_CONCURRENCY, async f => {
+        const size = await readImageSize(f.originalFile).catch(() => null);
+        if (size) f.pixels = size.width * size.height;
+        if (state.files.includes(f)) scheduleProcess(f); // Not removed while the header was read
+    });
 }
 
-async function processFile(fileEntry) {
-    const img = new Image();
-    img.src = fileEntry.originalUrl;
-    await new Promise(r => img.onload = r);
+async function processFile(fileEntry, effort = 'fast', priority = PRIORITY.BACKGROUND) {
+    if (!await ensureCodec(fileEntry.format)) fileEntry.format = 'jpeg';
+    // Files already optimized with these settings, in this or an earlier session, come from the store
+    const result = await engine.optimize(fileEntry.originalFile, { format: fileEntry.format, quality: fileEntry.quality, effort, priority });
+    if (result.cached) {
+        perf.manifestHits++;
+    } else {
+        if (!result.tid) perf.mainPool = canvasPoolStats();
+        traceStages(fileEntry, result.tid || 0, result.starts, result.timings);
+    }
+    const { blob, width, height, timings } = result;
 
-    const canvas = document.createElement('canvas');
-    canvas.width = img.width;
-    canvas.height = img.height;
-    const ctx = canvas.getContext('2d');
-    ctx.drawImage(img, 0, 0);
+    fileEntry.pixels = width * height;
+    fileEntry.effort = effort;
+    Object.assign(fileEntry.timings, timings);
 
-    const mimeType = `image/${fileEntry.format === 'jpg' ? 'jpeg' : fileEntry.format}`;
-    
-    // Compression logic using Canvas API
-    canvas.toBlob((blob) => {
-        if (fileEntry.compressedUrl) URL.revokeObjectURL(fileEntry.compressedUrl);
-        
-        fileEntry.compressedBlob = blob;
-        fileEntry.compressedUrl = URL.createObjectURL(blob);
-        fileEntry.compressedSize = blob.size;
-        
-        // Calculate savings
-        fileEntry.savings = 100 - ((blob.size / fileEntry.size) * 100);
+    if (fileEntry.compressedUrl) URL.revokeObjectURL(fileEntry.compressedUrl);
+
+    fileEntry.compressedBlob = blob;
+    fileEntry.compressedUrl = URL.createObjectURL(blob);
+    fileEntry.compressedSize = blob.size;
 
-        updateUI(); // Refresh UI with new stats
-    }, mimeType, fileEntry.quality / 100);
+    fileEntry.savings = result.savings;
+
+    scheduleRender(fileEntry); // Refresh UI with new stats
+    // Skip results of a watched file that was replaced while it encoded
+    if (fileEntry.watchPath && state.files.includes(fileEntry)) writeMirror(fileEntry);
+    return result;
+}
+
+// --- Capabilities ---
+
+/**
+ * Picks the encode path for this browser: the worker pool when workers can decode and draw
+ * off-screen, otherwise the main thread (with an <img> decode on browsers without createImageBitmap).
+ */
+function detectCapabilities() {
+    try {
+        caps.workers = !!window.Worker &&
+            typeof createImageBitmap !== 'undefined' &&
+            typeof OffscreenCanvas !== 'undefined' &&
+            !!new OffscreenCanvas(1, 1).getContext('2d');
+    } catch (err) {
+        caps.workers = false;
+    }
+}
+
+/**
+ * Loads an output format on first use: probes that the browser really encodes it and warms up
+ * the encoder in every worker, so the first real job doesn't pay the initialization.
+ * Resolves to whether the format is supported.
+ */
+function ensureCodec(format) {
+    if (!codecs.has(format)) codecs.set(format, loadCodec(format));
+    return codecs.get(format);
+}
+
+async function loadCodec(format) {
+    const supported = await probeEncoder(format).catch(() => false);
+    caps.encoders[format] = supported;
+
+    if (supported) {
+        if (workerPool) workerPool.broadcast({ type: 'warmup', format });
+    } else {
+        applyEncoderSupport();
+    }
+    return supported;
+}
+
+// Formats not chosen yet are loaded in idle time, so switching later is instant
+function prefetchCodecs() {
+    requestIdle(() => Object.keys(caps.encoders).forEach(ensureCodec));
+}
+
+function applyEncoderSupport() {
+    if (els.globalFormat) {
+        Array.from(els.globalFormat.options).forEach(o => o.disabled = !caps.encoders[o.value]);
+    }
+    if (!caps.encoders[state.globalFormat]) {
+        state.globalFormat = 'jpeg';
+        if (els.globalFormat) els.globalFormat.value = state.globalFormat;
+    }
+    state.files.forEach(f => {
+        if (!caps.encoders[f.format]) {
+            f.format = state.globalFormat;
+            scheduleProcess(f);
+        }
+    });
+    updateUI();
+}
+
+// --- Worker Pool ---
+
+function initWorkerPool() {
+    if (caps.workers) {
+        // Leave one core for the UI thread
+        workerPool = createWorkerPool({ size: Math.max(1, Math.min((navigator.hardwareConcurrency || 2) - 1, 8)) });
+        // Each worker gets a job queued behind the running one, so it never waits on a round trip to the page
+        encodeQueue.concurrency = workerPool.concurrency;
+    }
+    engine = createVelo(workerPool ? { pool: workerPool, cache: resultCache } : { workers: 0, cache: resultCache });
+}
+
+// --- Watch Folder ---
+
+/**
+ * Asks for an input and an output folder, then keeps optimizing images that appear or change in the
+ * input tree into the same relative paths of the output tree, with the global format/effort settings.
+ * Changes are picked up by FileSystemObserver where available and by polling otherwise. With an observer
+ * the folder is only rescanned on its events, plus once shortly after to confirm new files are complete.
+ */
+async function startWatch() {
+    try {
+        watch.input = await window.showDirectoryPicker({ id: 'velo-watch-in' });
+        watch.output = await window.showDirectoryPicker({ id: 'velo-watch-out', mode: 'readwrite' });
+    } catch (err) {
+        watch.input = watch.output = null;
+        return; // Picker dismissed
+    }
+    // An output inside the input would feed its own results back in
+    if (await watch.input.isSameEntry(watch.output) || await watch.input.resolve(watch.output)) {
+        alert('The output folder must not be inside the watched folder.');
+        watch.input = watch.output = null;
+        return;
+    }
+
+    watch.seen.clear();
+    if (window.FileSystemObserver) {
+        watch.observer = new FileSystemObserver(() => scanWatchFolder());
+        try {
+            await watch.observer.observe(watch.input, { recursive: true });
+        } catch (err) {
+            watch.observer = null;
+        }
+    }
+    if (!watch.observer) watch.timer = setInterval(scanWatchFolder, WATCH_POLL_MS);
+    if (els.btnWatch) els.btnWatch.textContent = 'Stop';
+    scanWatchFolder();
+}
+
+function stopWatch() {
+    clearInterval(watch.timer);
+    clearTimeout(watch.confirm);
+    if (watch.observer) watch.observer.disconnect();
+    watch.input = watch.output = watch.observer = watch.timer = watch.confirm = null;
+    if (els.btnWatch) els.btnWatch.textContent = 'Watch';
+}
+
+/**
+ * A file is queued once it was seen with the same size and mtime on two consecutive scans,
+ * so exports that are still being written aren't picked up half way.
+ */
+async function scanWatchFolder() {
+    if (!watch.input) return;
+    if (watch.scanning) {
+        watch.rescan = true;
+        return;
+    }
+    watch.scanning = true;
+    let unconfirmed = false;
+    try {
+        for await (const [path, handle] of walkDirectory(watch.input, '')) {
+            const file = await handle.getFile();
+            if (!file.type.startsWith('image/')) continue;
+
+            const prev = watch.seen.get(path);
+            if (prev && prev.size === file.size && prev.lastModified === file.lastModified) {
+                if (!prev.queued) {
+                    prev.queued = true;
+                    enqueueWatched(path, file);
+                }
+            } else {
+                watch.seen.set(path, { size: file.size, lastModified: file.lastModified, queued: false });
+                unconfirmed = true;
+            }
+        }
+    } catch (err) {
+        console.warn('VELO: watch scan failed', err);
+    } finally {
+        watch.scanning = false;
+    }
+
+    if (watch.rescan) {
+        watch.rescan = false;
+        scanWatchFolder();
+    } else if (unconfirmed && watch.observer && watch.confirm === null) {
+        // No event may follow the last write, so a file that was just seen is checked once more
+        watch.confirm = setTimeout(() => {
+            watch.confirm = null;
+            scanWatchFolder();
+        }, WATCH_POLL_MS);
+    }
+}
+
+async function* walkDirectory(dir, prefix) {
+    for await (const [name, handle] of dir.entries()) {
+        const path = prefix + name;
+        if (handle.kind === 'directory') yield* walkDirectory(handle, path + '/');
+        else yield [path, handle];
+    }
+}
+
+async function enqueueWatched(path, file) {
+    // A changed file replaces its previous version
+    const previous = state.files.find(f => f.watchPath === path);
+    if (previous) removeFile(previous.id);
+
+    const fileEntry = createFileEntry(file);
+    fileEntry.watchPath = path;
+    state.files.push(fileEntry);
+    if (!state.selectedFileId) state.selectedFileId = fileEntry.id;
+
+    const size = await readImageSize(file).catch(() => null);
+    if (size) fileEntry.pixels = size.width * size.height;
+    scheduleRender(fileEntry);
+    scheduleProcess(fileEntry);
+}
+
+async function writeMirror(fileEntry) {
+    if (!watch.output) return;
+    try {
+        const parts = fileEntry.watchPath.split('/');
+        parts.pop();
+        let dir = watch.output;
+        for (const part of parts) dir = await dir.getDirectoryHandle(part, { create: true });
+
+        const handle = await dir.getFileHandle(outputName(fileEntry.name, fileEntry.format), { create: true });
+        const writable = await handle.createWritable();
+        await writable.write(fileEntry.compressedBlob);
+        await writable.close();
+    } catch (err) {
+        console.warn(`VELO: could not write ${fileEntry.watchPath}`, err);
+        return;
+    }
+
+    // The output is on disk now: a long running watch keeps only the latest few in memory
+    fileEntry.mirrored = true;
+    const written = state.files.filter(f => f.mirrored);
+    written.slice(0, written.length - WATCH_KEEP_WRITTEN).forEach(f => removeFile(f.id));
+}
+
+// --- Batch API ---
+
+/**
+ * postMessage protocol, every reply echoes the request's `requestId`:
+ *   { type: 'velo:submit', files: [File|Blob], options: { format, quality } } -> 'velo:submitted' { jobId }
+ *   { type: 'velo:poll', jobId }  -> 'velo:status' { jobId, total, done, failed }
+ *   { type: 'velo:fetch', jobId } -> 'velo:results' { jobId, results: [{ name, blob, size, originalSize, error }] }
+ * 'velo:done' { jobId } is also pushed to the submitter when the last file finishes.
+ * Files are Blob references, nothing is copied until the encoder reads them. Submissions that would push
+ * the bytes held by unfetched jobs over API_MAX_BYTES get 'velo:error' { error: 'busy', retryAfter } instead,
+ * retryAfter in ms; a single submission over API_MAX_BYTES gets { error: 'too large', maxBytes } as it never fits.
+ * Jobs are dropped without a fetch when the submitting window closes, or API_RESULT_TTL_MS after finishing.
+ */
+function onApiMessage(event) {
+    const msg = event.data;
+    // Replies share the 'velo:' prefix and must not be answered, e.g. when a window talks to itself
+    if (!msg || !['velo:submit', 'velo:poll', 'velo:fetch'].includes(msg.type)) return;
+    if (!api.origins.includes(event.origin) || !event.source) return;
+
+    const reply = data => event.source.postMessage({ requestId: msg.requestId, ...data }, event.origin);
+    const job = api.jobs.get(msg.jobId);
+    if (msg.type !== 'velo:submit' && (!job || job.origin !== event.origin)) {
+        reply({ type: 'velo:error', error: 'unknown job' });
+        return;
+    }
+
+    switch (msg.type) {
+        case 'velo:submit': return reply(submitApiJob(msg, event));
+        case 'velo:poll': return reply({ type: 'velo:status', ...apiStatus(job) });
+        case 'velo:fetch': return reply(fetchApiJob(job));
+    }
+}
+
+function submitApiJob(msg, event) {
+    const blobs = Array.from(msg.files || []).filter(b => b instanceof Blob && b.type.startsWith('image/'));
+    if (blobs.length === 0) return { type: 'velo:error', error: 'no images' };
+
+    // Admission control: shed load instead of holding more than API_MAX_BYTES
+    const bytes = blobs.reduce((sum, b) => sum + b.size, 0);
+    if (bytes > API_MAX_BYTES) {
+        perf.apiRejected++;
+        return { type: 'velo:error', error: 'too large', maxBytes: API_MAX_BYTES };
+    }
+    if (api.bytes + bytes > API_MAX_BYTES) {
+        perf.apiRejected++;
+        return { type: 'velo:error', error: 'busy', retryAfter: apiRetryAfter() };
+    }
+
+    const options = msg.options || {};
+    const job = {
+        id: api.nextId++, source: event.source, origin: event.origin,
+        files: [], done: 0, failed: 0, bytes
+    };
+    api.bytes += bytes;
+    api.jobs.set(job.id, job);
+    if (api.sweep === null) api.sweep = setInterval(sweepApiJobs, API_SWEEP_MS);
+
+    blobs.forEach((blob, i) => {
+        const file = blob instanceof File ? blob : new File([blob], `image-${i + 1}.${blob.type.split('/')[1]}`, { type: blob.type });
+        const fileEntry = createFileEntry(file);
+        if (caps.encoders[options.format]) fileEntry.format = options.format;
+        if (options.quality) fileEntry.quality = Math.min(100, Math.max(1, parseInt(options.quality) || 75));
+        fileEntry.apiJob = job;
+        fileEntry.apiPending = true;
+        job.files.push(fileEntry);
+        state.files.push(fileEntry);
+        scheduleProcess(fileEntry);
+    });
+    updateUI();
+    return { type: 'velo:submitted', jobId: job.id };
+}
+
+function apiFileDone(fileEntry, error) {
+    const job = fileEntry.apiJob;
+    if (!fileEntry.apiPending) return;
+    fileEntry.apiPending = false;
+    if (!api.jobs.has(job.id)) return; // Released while this file was encoding
+    if (error) fileEntry.error = error;
+
+    if (fileEntry.compressedBlob) {
+        job.done++;
+        job.bytes += fileEntry.compressedSize;
+        api.bytes += fileEntry.compressedSize;
+    } else {
+        job.failed++;
+    }
+    if (job.done + job.failed === job.files.length) {
+        job.finishedAt = performance.now();
+        job.source.postMessage({ type: 'velo:done', jobId: job.id }, job.origin);
+    }
+}
+
+/**
+ * When a shed submission is worth retrying: once the queue has drained, or, if the budget is only held
+ * by finished results nobody fetched, once the oldest of them expires.
+ */
+function apiRetryAfter() {
+    const queuedMP = encodeQueue.pending.reduce((sum, f) => sum + jobCost(f), 0) / 1e6;
+    let ms = queuedMP * EFFORT[state.globalEffort].msPerMP / encodeQueue.concurrency;
+    if (ms === 0) {
+        const finished = [...api.jobs.values()].filter(j => j.finishedAt !== undefined);
+        if (finished.length > 0) ms = Math.min(...finished.map(j => j.finishedAt + API_RESULT_TTL_MS)) - performance.now();
+    }
+    return Math.ceil(Math.max(API_MIN_RETRY_MS, ms));
+}
+
+// Drops jobs whose submitter is gone or whose results were never fetched, so their bytes aren't held forever
+function sweepApiJobs() {
+    const now = performance.now();
+    api.jobs.forEach(job => {
+        if (job.source.closed || (job.finishedAt !== undefined && now - job.finishedAt > API_RESULT_TTL_MS)) releaseApiJob(job);
+    });
+}
+
+function apiStatus(job) {
+    return { jobId: job.id, total: job.files.length, done: job.done, failed: job.failed };
+}
+
+// Hands the results over and releases the job, its files and its share of API_MAX_BYTES
+function fetchApiJob(job) {
+    if (job.done + job.failed < job.files.length) return { type: 'velo:error', error: 'not finished', ...apiStatus(job) };
+
+    const results = job.files.map(f => ({
+        name: f.compressedBlob ? outputName(f.name, f.format) : f.name,
+        blob: f.compressedBlob,
+        size: f.compressedSize,
+        originalSize: f.size,
+        error: f.compressedBlob ? null : (f.error || 'failed')
+    }));
+    releaseApiJob(job);
+    return { type: 'velo:results', jobId: job.id, results };
+}
+
+function releaseApiJob(job) {
+    job.files.forEach(f => removeFile(f.id));
+    api.bytes -= job.bytes;
+    api.jobs.delete(job.id);
+    if (api.jobs.size === 0) {
+        clearInterval(api.sweep);
+        api.sweep = null;
+    }
+}
+
+// --- Encode Scheduling ---
+
+/**
+ * Queues a file for (re)compression. A file that is already queued keeps its slot,
+ * a file that is currently encoding is re-run once the current pass finishes.
+ */
+function scheduleProcess(fileEntry) {
+    if (fileEntry.encoding) {
+        fileEntry.dirty = true;
+        return;
+    }
+    if (!encodeQueue.pending.includes(fileEntry)) {
+        fileEntry.queuedAt = performance.now();
+        encodeQueue.pending.push(fileEntry);
+    }
+    pumpQueue();
+}
+
+// Selected file first, then rows visible in the sidebar, then everything else
+function jobPriority(fileEntry, visible) {
+    if (fileEntry.id === state.selectedFileId) return PRIORITY.SELECTED;
+    if (visible.has(fileEntry.id)) return PRIORITY.VISIBLE;
+    return PRIORITY.BACKGROUND;
+}
+
+// Estimated job cost in pixels. Before the first decode, roughly 10 px per byte of input.
+function jobCost(fileEntry) {
+    return fileEntry.pixels || fileEntry.size * 10;
+}
+
+// Ids of the sidebar rows currently in view. One pass over the rows, which are laid out top to
+// bottom, so it stops at the first row below the viewport.
+function visibleRowIds() {
+    const ids = new Set();
+    const scroller = els.fileListContainer && els.fileListContainer.parentElement;
+    if (!scroller) return ids;
+
+    const view = scroller.getBoundingClientRect();
+    if (view.height === 0) return ids; // Sidebar hidden
+    for (const row of els.fileListContainer.children) {
+        const r = row.getBoundingClientRect();
+        if (r.top >= view.bottom) break;
+        if (r.bottom > view.top) ids.add(row.dataset.id);
+    }
+    return ids;
+}
+
+// Priorities are evaluated at dequeue time, so selection and scrolling take effect immediately
+function takeNextJob() {
+    const visible = visibleRowIds();
+    let best = null, bestPriority = Infinity;
+    for (const f of encodeQueue.pending) {
+        const p = jobPriority(f, visible);
+        if (p < bestPriority || (p === bestPriority && jobCost(f) < jobCost(best))) {
+            best = f;
+            bestPriority = p;
+        }
+    }
+    return best ? { fileEntry: best, priority: bestPriority } : null;
+}
+
+function pumpQueue() {
+    while (encodeQueue.running < encodeQueue.concurrency && encodeQueue.pending.length > 0) {
+        const next = takeNextJob();
+
+        // Background work only starts when the main thread is idle
+        if (next.priority === PRIORITY.BACKGROUND) {
+            if (encodeQueue.idleHandle === null) {
+                encodeQueue.idleHandle = requestIdle(() => {
+                    encodeQueue.idleHandle = null;
+                    const job = takeNextJob();
+                    if (job && encodeQueue.running < encodeQueue.concurrency) runJob(job.fileEntry, job.priority);
+                    pumpQueue();
+                });
+            }
+            return;
+        }
+        runJob(next.fileEntry, next.priority);
+    }
+}
+
+async function runJob(fileEntry, priority) {
+    encodeQueue.pending.splice(encodeQueue.pending.indexOf(fileEntry), 1);
+    if (!state.files.includes(fileEntry)) { // Removed while queued
+        if (fileEntry.apiJob) apiFileDone(fileEntry, 'removed');
+        return;
+    }
+
+    if (!batch.active) {
+        batch.active = true;
+        batch.deadline = performance.now() + state.timeBudget;
+    }
+
+    encodeQueue.running++;
+    fileEntry.encoding = true;
+    const effort = chooseEffort(fileEntry);
+    const start = performance.now();
+    fileEntry.timings = { queue: start - fileEntry.queuedAt };
+    try {
+        const result = await processFile(fileEntry, effort, priority);
+        // A store hit costs a lookup, not an encode: it would skew the cost model, throughput and latencies
+        if (!result.cached) {
+            recordEffortCost(effort, performance.now() - start, fileEntry.pixels);
+            recordJob(fileEntry, start);
+        }
+    } catch (err) {
+        console.error(`VELO: failed to process ${fileEntry.name}`, err);
+        fileEntry.error = err.message || String(err);
+    } finally {
+        fileEntry.encoding = false;
+        encodeQueue.running--;
+        if (fileEntry.dirty && state.files.includes(fileEntry)) {
+            fileEntry.dirty = false;
+            fileEntry.queuedAt = performance.now();
+            encodeQueue.pending.push(fileEntry);
+        } else if (fileEntry.apiJob) {
+            apiFileDone(fileEntry);
+        }
+        if (encodeQueue.running === 0 && encodeQueue.pending.length === 0) batch.active = false;
+        pumpQueue();
+    }
+}
+
+/**
+ * Picks the effort for the next job. Without a time budget this is the global effort,
+ * otherwise the highest tier whose estimated cost for the remaining batch still fits the deadline.
+ */
+function chooseEffort(fileEntry) {
+    const maxRank = EFFORT[state.globalEffort].rank;
+    if (!state.timeBudget) return state.globalEffort;
+
+    const remainingMs = batch.deadline - performance.now();
+    const remainingMP = (encodeQueue.pending.reduce((sum, f) => sum + jobCost(f), 0) + jobCost(fileEntry)) / 1e6;
+    const tiers = Object.keys(EFFORT).filter(e => EFFORT[e].rank <= maxRank).reverse();
+
+    return tiers.find(e => remainingMP * EFFORT[e].msPerMP / encodeQueue.concurrency <= remainingMs) || 'fast';
+}
+
+function recordEffortCost(effort, ms, pixels) {
+    if (!pixels) return;
+    const sample = ms / (pixels / 1e6);
+    EFFORT[effort].msPerMP = EFFORT[effort].msPerMP * 0.8 + sample * 0.2;
+}
+
+function requestIdle(cb) {
+    if (window.requestIdleCallback) return requestIdleCallback(cb, { timeout: 500 });
+    return setTimeout(cb, 50);
 }
 
 function removeFile(id) {
@@ -170,6 +890,7 @@ function removeFile(id) {
         URL.revokeObjectURL(f.originalUrl);
         if (f.compressedUrl) URL.revokeObjectURL(f.compressedUrl);
         state.files.splice(idx, 1);
+        f.dirty = false;
         
         if (state.selectedFileId === id) {
             state.selectedFileId = state.files.length > 0 ? state.files[0].id : null;
@@ -182,15 +903,40 @@ function clearAll() {
     state.files.forEach(f => {
         URL.revokeObjectURL(f.originalUrl);
         if (f.compressedUrl) URL.revokeObjectURL(f.compressedUrl);
+        if (f.apiJob && !f.encoding) apiFileDone(f, 'removed');
     });
     state.files = [];
+    encodeQueue.pending = [];
     state.selectedFileId = null;
     updateUI();
 }
 
 // --- UI Rendering ---
 
+async function renderStoreStats() {
+    // Importing writes to the store and exporting reads it: both only while the user keeps results
+    [els.btnStoreExport, els.btnStoreImport].forEach(btn => { if (btn) btn.disabled = !state.keepResults; });
+    if (!els.storeStatsLabel) return;
+    const stats = await storeStats().catch(() => null);
+    els.storeStatsLabel.textContent = stats ? `${stats.count} stored, ${formatSize(stats.bytes)}` : 'unavailable';
+}
+
+// Jobs finishing within the same frame share one updateUI instead of rebuilding the list once each
+function scheduleRender(fileEntry) {
+    render.files.push(fileEntry);
+    if (render.frame === null) render.frame = requestAnimationFrame(flushRender);
+}
+
+function flushRender() {
+    render.frame = null;
+    updateUI();
+    render.files.forEach(f => { if (f.timings) f.timings.ui = perf.uiMs; });
+    render.files = [];
+}
+
 function updateUI() {
+    const uiStart = performance.now();
+
     // Toggle Views (Init vs App)
     if (state.files.length === 0) {
         if(els.initOverlay) els.initOverlay.classList.remove('d-none');
@@ -209,6 +955,8 @@ function updateUI() {
     if(els.filesCountLabel) els.filesCountLabel.textContent = `SELECTED FILES (${state.files.length})`;
     renderFileList();
     renderPreview();
+
+    perf.uiMs = performance.now() - uiStart;
 }
 
 function renderFileList() {
@@ -220,6 +968,7 @@ function renderFileList() {
         const div = document.createElement('div');
         div.className = `file-item p-2 mb-2 rounded ${isSelected ? 'active border border-2 border-primary shadow-glow' : 'border border-secondary'}`;
         div.style.cursor = 'pointer';
+        div.dataset.id = file.id;
         div.onclick = () => { state.selectedFileId = file.id; updateUI(); };
 
         const savingsText = file.savings >= 0 ? `-${file.savings.toFixed(1)}%` : `+${Math.abs(file.savings).toFixed(1)}%`;
@@ -228,7 +977,7 @@ function renderFileList() {
         div.innerHTML = `
             <div class="d-flex justify-content-between align-items-start mb-2">
                 <div class="text-truncate max-w-75">
-                    <div class="text-white fw-bold small">${file.name}</div>
+                    <div class="text-white fw-bold small">${escapeHtml(file.name)}</div>
                     <div class="mt-1">
                         <small class="text-muted">Before: ${formatSize(file.size)}</small>
                         <small class="${savingsClass} fw-bold ms-2">After: ${formatSize(file.compressedSize)} (${savingsText})</small>
@@ -243,9 +992,9 @@ function renderFileList() {
             <div class="row align-items-center g-2 border-top border-secondary pt-2 mt-1">
                 <div class="col-auto">
                     <select class="form-select form-select-sm bg-dark text-white border-secondary p-0 ps-1 select-xs file-format">
-                        <option value="jpeg" ${file.format === 'jpeg' ? 'selected' : ''}>JPG</option>
-                        <option value="webp" ${file.format === 'webp' ? 'selected' : ''}>WEBP</option>
-                        <option value="png" ${file.format === 'png' ? 'selected' : ''}>PNG</option>
+                        <option value="jpeg" ${file.format === 'jpeg' ? 'selected' : ''} ${caps.encoders.jpeg ? '' : 'disabled'}>JPG</option>
+                        <option value="webp" ${file.format === 'webp' ? 'selected' : ''} ${caps.encoders.webp ? '' : 'disabled'}>WEBP</option>
+                        <option value="png" ${file.format === 'png' ? 'selected' : ''} ${caps.encoders.png ? '' : 'disabled'}>PNG</option>
                     </select>
                 </div>
                 <div class="col d-flex align-items-center gap-2">
@@ -261,7 +1010,7 @@ function renderFileList() {
             e.stopPropagation(); 
             file.quality = 75; 
             state.selectedFileId = file.id;
-            processFile(file); 
+            scheduleProcess(file); 
         };
         div.querySelector('.btn-download').onclick = (e) => {
             e.stopPropagation();
@@ -270,7 +1019,7 @@ function renderFileList() {
         
         const formatSel = div.querySelector('.file-format');
         formatSel.onclick = (e) => e.stopPropagation();
-        formatSel.onchange = (e) => { file.format = e.target.value; processFile(file); };
+        formatSel.onchange = (e) => { file.format = e.target.value; ensureCodec(file.format); scheduleProcess(file); };
 
         const qualityRange = div.querySelector('.file-quality');
         qualityRange.onclick = (e) => e.stopPropagation();
@@ -278,7 +1027,7 @@ function renderFileList() {
             file.quality = parseInt(e.target.value); 
             div.querySelector('.badge').textContent = file.quality + '%';
         };
-        qualityRange.onchange = () => processFile(file); // Commit change on release
+        qualityRange.onchange = () => scheduleProcess(file); // Commit change on release
 
         els.fileListContainer.appendChild(div);
     });
@@ -390,6 +1139,208 @@ function stopDrag() {
     if(els.veloContainer) els.veloContainer.style.cursor = 'grab';
 }
 
+// --- Performance ---
+
+function recordJob(fileEntry, start) {
+    const end = performance.now();
+    performance.measure(`velo:job ${fileEntry.name}`, { start, end, detail: fileEntry.timings });
+    traceAsync('job', fileEntry.id, 0, performance.timeOrigin + start, end - start, { file: fileEntry.name, effort: fileEntry.effort });
+
+    if (!perf.firstJobAt) perf.firstJobAt = start;
+    perf.lastJobAt = end;
+    perf.completed++;
+    perf.pixels += fileEntry.pixels;
+    perf.bytesIn += fileEntry.size;
+    perf.bytesOut += fileEntry.compressedSize;
+    Object.entries(fileEntry.timings).forEach(([stage, ms]) => recordValue(histogramFor(perf.histograms, `${stage}:${fileEntry.format}`), ms));
+    recordValue(histogramFor(perf.histograms, `total:${fileEntry.format}`), end - start);
+    traceCounter('bytes', { in: perf.bytesIn, out: perf.bytesOut });
+    traceCounter('queue', { pending: encodeQueue.pending.length, running: encodeQueue.running });
+    if (performance.memory) traceCounter('heap', { used: performance.memory.usedJSHeapSize });
+
+    perf.recent.unshift({ name: fileEntry.name, pixels: fileEntry.pixels, effort: fileEntry.effort, timings: fileEntry.timings });
+    if (perf.recent.length > 50) perf.recent.pop();
+}
+
+function observeLongTasks() {
+    if (!window.PerformanceObserver || !PerformanceObserver.supportedEntryTypes?.includes('longtask')) return;
+    new PerformanceObserver(list => {
+        list.getEntries().forEach(e => perf.longTasks.push({ start: e.startTime, duration: e.duration }));
+        if (perf.longTasks.length > 200) perf.longTasks.splice(0, perf.longTasks.length - 200);
+    }).observe({ type: 'longtask', buffered: true });
+}
+
+function perfSnapshot() {
+    const now = performance.now();
+    const activeMs = perf.firstJobAt ? perf.lastJobAt - perf.firstJobAt : 0;
+    const pool = workerPool ? workerPool.stats() : { workers: 0, busyMs: 0, restarts: 0, failedJobs: 0, pools: {} };
+    const poolMs = perf.firstJobAt ? (now - perf.firstJobAt) * pool.workers : 0;
+
+    return {
+        queueDepth: encodeQueue.pending.length,
+        running: encodeQueue.running,
+        workers: pool.workers,
+        workerRestarts: pool.restarts,
+        failedJobs: pool.failedJobs, // Jobs that crashed or hung their worker on every attempt
+        workerUtilization: poolMs > 0 ? pool.busyMs / poolMs : 0,
+        completed: perf.completed,
+        manifestHits: perf.manifestHits,
+        imagesPerSecond: activeMs > 0 ? perf.completed / (activeMs / 1000) : 0,
+        megapixelsPerSecond: activeMs > 0 ? (perf.pixels / 1e6) / (activeMs / 1000) : 0,
+        bytesIn: perf.bytesIn,
+        bytesOut: perf.bytesOut,
+        heapUsed: performance.memory ? performance.memory.usedJSHeapSize : null,
+        blobBytes: state.files.reduce((sum, f) => sum + (f.compressedBlob ? f.compressedSize : 0), 0),
+        canvasPool: Object.values(pool.pools).concat(perf.mainPool ? canvasPoolStats() : []).reduce((sum, p) => {
+            Object.keys(p).forEach(k => sum[k] = (sum[k] || 0) + p[k]);
+            return sum;
+        }, {}),
+        lastUiMs: perf.uiMs,
+        longTasks: perf.longTasks.length,
+        longTaskMs: perf.longTasks.reduce((sum, t) => sum + t.duration, 0)
+    };
+}
+
+function togglePerfHud(show) {
+    perf.hudVisible = show;
+    if (els.perfHud) els.perfHud.classList.toggle('d-none', !show);
+    if (els.btnPerf) els.btnPerf.classList.toggle('active', show);
+
+    clearInterval(perf.hudTimer);
+    if (show) {
+        renderPerfHud();
+        perf.hudTimer = setInterval(renderPerfHud, 500);
+    }
+}
+
+function renderPerfHud() {
+    if (!els.perfHudBody) return;
+    const s = perfSnapshot();
+    const ms = (v) => v === undefined ? '-' : v.toFixed(1);
+
+    const rows = perf.recent.slice(0, 10).map(j => `
+        <tr>
+            <td class="text-truncate perf-name">${escapeHtml(j.name)}</td>
+            <td>${ms(j.timings.queue)}</td><td>${ms(j.timings.decode)}</td><td>${ms(j.timings.raster)}</td>
+            <td>${ms(j.timings.encode)}</td><td>${ms(j.timings.ui)}</td>
+        </tr>`).join('');
+
+    els.perfHudBody.innerHTML = `
+        <div>Queue ${s.queueDepth} · running ${s.running} · workers ${s.workers} (${(s.workerUtilization * 100).toFixed(0)}% busy) · ${s.workerRestarts} restarts, ${s.failedJobs} failed</div>
+        <div>${s.completed} encoded · ${s.manifestHits} from store · ${s.imagesPerSecond.toFixed(1)} img/s · ${s.megapixelsPerSecond.toFixed(1)} MP/s</div>
+        <div>In ${formatSize(s.bytesIn)} → out ${formatSize(s.bytesOut)} · blobs ${formatSize(s.blobBytes)}${s.heapUsed !== null ? ` · heap ${formatSize(s.heapUsed)}` : ''}</div>
+        <div>Canvas pool ${formatSize(s.canvasPool.liveBytes || 0)} live · ${formatSize(s.canvasPool.pooledBytes || 0)} pooled · peak ${formatSize(s.canvasPool.peakBytes || 0)} · ${s.canvasPool.hits || 0}/${(s.canvasPool.hits || 0) + (s.canvasPool.misses || 0)} reused</div>
+        <div>Last UI update ${ms(s.lastUiMs)} ms · long tasks ${s.longTasks} (${ms(s.longTaskMs)} ms)</div>
+        <table class="perf-table mt-1">
+            <tr><th>File</th><th>Queue</th><th>Decode</th><th>Raster</th><th>Encode</th><th>UI</th></tr>
+            ${rows}
+        </table>
+    `;
+}
+
+// Page side of the service worker's /metrics endpoint, merged there with the other pages and the proxy
+function metricsSnapshot() {
+    const s = perfSnapshot();
+    return {
+        histograms: perf.histograms,
+        counters: {
+            jobs_total: s.completed,
+            job_failures_total: s.failedJobs,
+            worker_restarts_total: s.workerRestarts,
+            store_hits_total: s.manifestHits,
+            bytes_in_total: s.bytesIn,
+            bytes_out_total: s.bytesOut,
+            api_rejections_total: perf.apiRejected
+        },
+        gauges: {
+            queue_depth: s.queueDepth,
+            jobs_running: s.running,
+            workers: s.workers,
+            canvas_pool_bytes: (s.canvasPool.liveBytes || 0) + (s.canvasPool.pooledBytes || 0),
+            heap_bytes: s.heapUsed || 0,
+            api_held_bytes: api.bytes
+        }
+    };
+}
+
+// Downloads the HUD data as JSON, for attaching to bug reports
+function exportPerf() {
+    const report = {
+        date: new Date().toISOString(),
+        userAgent: navigator.userAgent,
+        hardwareConcurrency: navigator.hardwareConcurrency,
+        caps,
+        summary: perfSnapshot(),
+        jobs: perf.recent,
+        longTasks: perf.longTasks,
+        measures: performance.getEntriesByType('measure').filter(m => m.name.startsWith('velo:')).map(m => m.toJSON())
+    };
+    const blob = new Blob([JSON.stringify(report, null, 2)], { type: 'application/json' });
+    const a = document.createElement('a');
+    a.href = URL.createObjectURL(blob);
+    a.download = 'velo-perf.json';
+    document.body.appendChild(a);
+    a.click();
+    document.body.removeChild(a);
+    URL.revokeObjectURL(a.href);
+}
+
+// --- Tracing ---
+// All helpers return immediately when tracing is off. Timestamps are wall-clock ms (timeOrigin + now)
+// so spans measured inside workers line up with the main thread; tid 0 is the main thread.
+
+function traceEvent(event) {
+    trace.events[trace.next] = event;
+    trace.next = (trace.next + 1) % TRACE_CAPACITY;
+}
+
+function traceSpan(name, tid, startMs, durMs, args) {
+    if (!trace.enabled) return;
+    traceEvent({ name, cat: 'velo', ph: 'X', pid: 1, tid, ts: startMs * 1000, dur: durMs * 1000, args });
+}
+
+// Async span (b/e pair): may overlap others on the same thread, unlike complete ('X') events which must nest
+function traceAsync(name, id, tid, startMs, durMs, args) {
+    if (!trace.enabled) return;
+    const event = { name, cat: 'velo', pid: 1, tid, id: String(id) };
+    traceEvent({ ...event, ph: 'b', ts: startMs * 1000, args });
+    traceEvent({ ...event, ph: 'e', ts: (startMs + durMs) * 1000 });
+}
+
+function traceCounter(name, values) {
+    if (!trace.enabled) return;
+    traceEvent({ name, cat: 'velo', ph: 'C', pid: 1, tid: 0, ts: (performance.timeOrigin + performance.now()) * 1000, args: values });
+}
+
+/**
+ * Stages of one job on thread tid, at the start times the encoder reported. Raster is synchronous and
+ * never overlaps another; decode and encode wait on the browser and do (a prefetched decode runs during
+ * the previous encode, the main thread encodes two images at once), so they are async spans.
+ */
+function traceStages(fileEntry, tid, starts, timings) {
+    if (!trace.enabled || !starts) return;
+    traceAsync('decode', fileEntry.id, tid, starts.decode, timings.decode, { file: fileEntry.name });
+    traceSpan('raster', tid, starts.raster, timings.raster, { file: fileEntry.name });
+    traceAsync('encode', fileEntry.id, tid, starts.encode, timings.encode, { file: fileEntry.name });
+}
+
+// Downloads the ring buffer as Chrome Trace Event JSON (chrome://tracing, ui.perfetto.dev)
+function exportTrace() {
+    const events = trace.events.slice(trace.next).concat(trace.events.slice(0, trace.next));
+    const workers = workerPool ? workerPool.size : 0;
+    const threads = [{ tid: 0, name: 'main' }].concat(Array.from({ length: workers }, (_, i) => ({ tid: i + 1, name: `worker ${i + 1}` })));
+    threads.forEach(t => events.push({ name: 'thread_name', ph: 'M', pid: 1, tid: t.tid, args: { name: t.name } }));
+
+    const blob = new Blob([JSON.stringify({ traceEvents: events, displayTimeUnit: 'ms' })], { type: 'application/json' });
+    const a = document.createElement('a');
+    a.href = URL.createObjectURL(blob);
+    a.download = 'velo-trace.json';
+    document.body.appendChild(a);
+    a.click();
+    document.body.removeChild(a);
+    URL.revokeObjectURL(a.href);
+}
+
 // --- Utilities ---
 
 function formatSize(bytes) {
@@ -400,11 +1351,52 @@ function formatSize(bytes) {
     return parseFloat((bytes / Math.pow(k, i)).toFixed(1)) + ' ' + sizes[i];
 }
 
+// File names come from the user's disk or from API submitters, never trust them as markup
+function escapeHtml(text) {
+    return String(text).replace(/[&<>"']/g, c => ({ '&': '&amp;', '<': '&lt;', '>': '&gt;', '"': '&quot;', "'": '&#39;' })[c]);
+}
+
+// Loads a classic script once, resolves when it has executed
+function loadScript(src) {
+    if (!loadedScripts.has(src)) {
+        loadedScripts.set(src, new Promise((resolve, reject) => {
+            const script = document.createElement('script');
+            script.src = src;
+            script.onload = resolve;
+            script.onerror = () => { loadedScripts.delete(src); reject(new Error(`Failed to load ${src}`)); };
+            document.head.appendChild(script);
+        }));
+    }
+    return loadedScripts.get(src);
+}
+
+function registerServiceWorker() {
+    if (!('serviceWorker' in navigator)) return;
+    // After load, so precaching doesn't compete with the first paint
+    window.addEventListener('load', () => {
+        navigator.serviceWorker.register('sw.js').catch(err => console.warn('VELO: service worker not registered', err));
+    });
+    navigator.serviceWorker.addEventListener('message', e => {
+        if (e.data && e.data.type === 'velo:metrics' && e.ports[0]) e.ports[0].postMessage(metricsSnapshot());
+    });
+}
+
+// Runs fn(item, index) over items with at most `limit` calls in flight
+async function mapLimit(items, limit, fn) {
+    let next = 0;
+    const lanes = Array.from({ length: Math.min(limit, items.length) }, async () => {
+        while (next < items.length) {
+            const i = next++;
+            await fn(items[i], i);
+        }
+    });
+    await Promise.all(lanes);
+}
+
 function downloadSingle(file) {
     const a = document.createElement('a');
     a.href = file.compressedUrl;
-    const ext = file.format === 'jpeg' ? 'jpg' : file.format;
-    a.download = file.name.substring(0, file.name.lastIndexOf('.')) + '.' + ext;
+    a.download = outputName(file.name, file.format);
     document.body.appendChild(a);
     a.click();
     document.body.removeChild(a);
@@ -413,20 +1405,57 @@ function downloadSingle(file) {
 async function downloadZip() {
     if (state.files.length === 0) return;
     
-    const zip = new JSZip();
-    
-    state.files.forEach(file => {
-        const ext = file.format === 'jpeg' ? 'jpg' : file.format;
-        const name = file.name.substring(0, file.name.lastIndexOf('.')) + '.' + ext;
-        // Get blob data
-        zip.file(name, file.compressedBlob);
-    });
-
-    const content = await zip.generateAsync({ type: "blob" });
+    await loadScript('assets/js/jszip.min.js');
+    const names = uniqueOutputNames(state.files);
+    const content = await zipResults(state.files.map((f, i) => ({ name: names[i], blob: f.compressedBlob })));
     const a = document.createElement('a');
     a.href = URL.createObjectURL(content);
     a.download = "images.zip";
     document.body.appendChild(a);
     a.click();
     document.body.removeChild(a);
-}
\ No newline at end of file
+}
+
+// Writes every output straight into a folder the user picks, several files at a time (File System Access API)
+async function saveToFolder() {
+    const done = state.files.filter(f => f.compressedBlob);
+    if (done.length === 0) return;
+
+    let dir;
+    try {
+        dir = await window.showDirectoryPicker({ mode: 'readwrite' });
+    } catch (err) {
+        return; // Picker dismissed
+    }
+
+    const names = uniqueOutputNames(done);
+    const failed = [];
+    await mapLimit(done, IO_CONCURRENCY, async (file, i) => {
+        try {
+            const handle = await dir.getFileHandle(names[i], { create: true });
+            const writable = await handle.createWritable();
+            await writable.write(file.compressedBlob);
+            await writable.close();
+        } catch (err) {
+            console.warn(`VELO: could not write ${names[i]}`, err);
+            failed.push(names[i]);
+        }
+    });
+    if (failed.length > 0) {
+        alert(`${failed.length} of ${done.length} images could not be saved:\n${failed.join('\n')}`);
+    }
+}
+
+// Output names for files saved side by side: "a.png" and "a.jpg" both becoming "a.jpg" get "a (2).jpg".
+// Compared case-insensitively, as most file systems do.
+function uniqueOutputNames(files) {
+    const taken = new Set();
+    return files.map(f => {
+        const name = outputName(f.name, f.format);
+        const dot = name.lastIndexOf('.');
+        let unique = name;
+        for (let n = 2; taken.has(unique.toLowerCase()); n++) unique = `${name.slice(0, dot)} (${n})${name.slice(dot)}`;
+        taken.add(unique.toLowerCase());
+        return unique;
+    });
+}
@@ -0,0 +1,649 @@
+/**
+ * VELO - Benchmark
+ * Runs the encode pipeline over a local image corpus and reports throughput and compression
+ * per codec/setting, as a table and as JSON that can be compared against a saved baseline.
+ * Jobs run on the library's worker pool (velo.js), the same the app encodes on.
+ */
+
+import { createWorkerPool } from './velo.js';
+
+const REPORT_VERSION = 1;
+
+const bench = {
+    kernelReport: null,
+    rdReport: null,
+    loadReport: null,
+    rdCache: new Map(),  // `${hash}|${format}|${quality}|${effort}` -> { bytes, pixels, psnr, ssim }
+    corpus: [],         // { file, category, hash }
+    corpusId: null,
+    report: null,
+    baseline: null,
+    pool: null          // createWorkerPool() of the running benchmark
+};
+
+// DOM Elements cache
+const els = {};
+
+document.addEventListener('DOMContentLoaded', () => {
+    const ids = [
+        'corpusInput', 'benchFormats', 'benchQualities', 'benchEffort', 'benchWorkers', 'benchRuns',
+        'btnRun', 'btnExport', 'baselineInput', 'benchStatus', 'resultsBody',
+        'kernelSizes', 'btnRunKernels', 'btnExportKernels', 'kernelsBody',
+        'rdConfigs', 'rdQualities', 'rdMetric', 'btnRunRd', 'btnExportRd', 'rdBody',
+        'loadUrls', 'loadRate', 'loadDuration', 'btnRunLoad', 'btnExportLoad', 'loadBody'
+    ];
+    ids.forEach(id => {
+        const el = document.getElementById(id);
+        if (el) els[id] = el;
+    });
+
+    if(els.benchWorkers) els.benchWorkers.value = Math.max(1, (navigator.hardwareConcurrency || 2) - 1);
+    if(els.corpusInput) els.corpusInput.onchange = (e) => loadCorpus(e.target.files);
+    if(els.baselineInput) els.baselineInput.onchange = (e) => loadBaseline(e.target.files[0]);
+    if(els.btnRun) els.btnRun.onclick = runBenchmark;
+    if(els.btnExport) els.btnExport.onclick = () => downloadJson(bench.report, 'velo-bench.json');
+    if(els.btnRunKernels) els.btnRunKernels.onclick = runKernels;
+    if(els.btnExportKernels) els.btnExportKernels.onclick = () => downloadJson(bench.kernelReport, 'velo-kernels.json');
+    if(els.btnRunRd) els.btnRunRd.onclick = runRd;
+    if(els.btnExportRd) els.btnExportRd.onclick = () => downloadJson(bench.rdReport, 'velo-rd.json');
+    if(els.btnRunLoad) els.btnRunLoad.onclick = runLoad;
+    if(els.btnExportLoad) els.btnExportLoad.onclick = () => downloadJson(bench.loadReport, 'velo-load.json');
+});
+
+// --- Corpus ---
+
+async function loadCorpus(fileList) {
+    const files = Array.from(fileList).filter(f => f.type.startsWith('image/'));
+    setStatus(`Hashing ${files.length} files...`);
+
+    bench.corpus = [];
+    for (const file of files) {
+        // webkitRelativePath is "corpus/<category>/<file>"
+        const parts = (file.webkitRelativePath || file.name).split('/');
+        const category = parts.length > 2 ? parts[1] : 'uncategorized';
+        bench.corpus.push({ file, category, hash: await sha256(file) });
+    }
+    bench.corpus.sort((a, b) => a.file.webkitRelativePath.localeCompare(b.file.webkitRelativePath));
+
+    const hashes = new TextEncoder().encode(bench.corpus.map(c => c.hash).sort().join(''));
+    bench.corpusId = await sha256(new Blob([hashes]));
+
+    if(els.btnRun) els.btnRun.disabled = bench.corpus.length === 0;
+    if(els.btnRunRd) els.btnRunRd.disabled = bench.corpus.length === 0;
+    setStatus(`${bench.corpus.length} images, ${formatSize(bench.corpus.reduce((s, c) => s + c.file.size, 0))}, corpus ${bench.corpusId.slice(0, 12)}`);
+}
+
+async function sha256(blob) {
+    const digest = await crypto.subtle.digest('SHA-256', await blob.arrayBuffer());
+    return Array.from(new Uint8Array(digest), b => b.toString(16).padStart(2, '0')).join('');
+}
+
+async function loadBaseline(file) {
+    if (!file) return;
+    bench.baseline = JSON.parse(await file.text());
+    if (bench.baseline.corpus?.id !== bench.corpusId) {
+        setStatus('Baseline was taken on a different corpus, deltas are not comparable.');
+    }
+    renderResults();
+}
+
+// --- Worker Pool ---
+
+function startWorkers(count) {
+    stopWorkers();
+    bench.pool = createWorkerPool({ size: count });
+}
+
+function stopWorkers() {
+    if (bench.pool) bench.pool.terminate();
+    bench.pool = null;
+}
+
+function runInWorker(job) {
+    return bench.pool.run(job);
+}
+
+// --- Benchmark ---
+
+async function runBenchmark() {
+    const formats = els.benchFormats.value.split(',').map(s => s.trim()).filter(Boolean);
+    const qualities = els.benchQualities.value.split(',').map(s => parseInt(s)).filter(q => q > 0 && q <= 100);
+    const effort = els.benchEffort.value;
+    const runs = Math.max(1, parseInt(els.benchRuns.value) || 1);
+    const workers = Math.max(1, parseInt(els.benchWorkers.value) || 1);
+
+    els.btnRun.disabled = true;
+    startWorkers(workers);
+
+    const results = [];
+    try {
+        for (const format of formats) {
+            for (const quality of qualities) {
+                setStatus(`Running ${format} q${quality} ${effort}...`);
+                results.push(await benchSetting(format, quality, effort, runs));
+                bench.report = makeReport(workers, runs, results);
+                renderResults();
+            }
+        }
+        const failed = Math.max(0, ...results.map(r => r.failed));
+        setStatus(`Done: ${results.length} settings over ${bench.corpus.length} images${failed ? `, skipped ${failed} that could not be encoded` : ''}.`);
+    } catch (err) {
+        setStatus(`Benchmark failed: ${err.message || err}`);
+    } finally {
+        stopWorkers();
+        els.btnRun.disabled = false;
+        els.btnExport.disabled = !bench.report;
+    }
+}
+
+/**
+ * Encodes the whole corpus `runs` times with one setting and keeps the median wall time.
+ * All images are in flight at once, so this measures throughput of the worker pool.
+ * Images that fail to decode or encode (SVG, HEIC, TIFF... in the folder) are skipped and counted in `failed`.
+ * peakPageHeap samples the page's JS heap only: decoding and encoding run in the workers, whose memory
+ * the page can't observe.
+ */
+async function benchSetting(format, quality, effort, runs) {
+    const times = [];
+    let outputs = null;
+    let peakPageHeap = null;
+
+    for (let r = 0; r < runs; r++) {
+        const sampler = setInterval(() => {
+            if (performance.memory) peakPageHeap = Math.max(peakPageHeap || 0, performance.memory.usedJSHeapSize);
+        }, 50);
+        const start = performance.now();
+        outputs = await Promise.all(bench.corpus.map(c => runInWorker({ file: c.file, format, quality, effort }).catch(() => null)));
+        times.push(performance.now() - start);
+        clearInterval(sampler);
+    }
+    times.sort((a, b) => a - b);
+    const seconds = times[Math.floor(times.length / 2)] / 1000;
+
+    // Quality and sizes, overall and per category. Decoded one image at a time to bound memory on huge images.
+    const byCategory = {};
+    let psnrSum = 0, psnrCount = 0, pixels = 0, bytesIn = 0, bytesOut = 0, images = 0;
+    for (let i = 0; i < outputs.length; i++) {
+        const c = bench.corpus[i], out = outputs[i];
+        if (!out) continue;
+        const value = psnr(await decodePixels(c.file), await decodePixels(out.blob));
+        images++;
+        const cat = byCategory[c.category] || (byCategory[c.category] = { images: 0, bytesIn: 0, bytesOut: 0, psnr: 0 });
+
+        cat.images++;
+        cat.bytesIn += c.file.size;
+        cat.bytesOut += out.blob.size;
+        if (isFinite(value)) {
+            cat.psnr += value;
+            psnrSum += value;
+            psnrCount++;
+        }
+        pixels += out.width * out.height;
+        bytesIn += c.file.size;
+        bytesOut += out.blob.size;
+    }
+    Object.values(byCategory).forEach(cat => cat.psnr = cat.psnr / cat.images);
+
+    return {
+        key: `${format}/q${quality}/${effort}`,
+        format, quality, effort,
+        images,
+        failed: outputs.length - images,
+        pixels,
+        seconds,
+        imagesPerSecond: images / seconds,
+        megapixelsPerSecond: pixels / 1e6 / seconds,
+        bytesIn,
+        bytesOut,
+        ratio: bytesOut / bytesIn,
+        psnr: psnrCount > 0 ? psnrSum / psnrCount : null,
+        peakPageHeap,
+        byCategory
+    };
+}
+
+function makeReport(workers, runs, results) {
+    return {
+        version: REPORT_VERSION,
+        date: new Date().toISOString(),
+        userAgent: navigator.userAgent,
+        hardwareConcurrency: navigator.hardwareConcurrency,
+        workers,
+        runs,
+        corpus: {
+            id: bench.corpusId,
+            images: bench.corpus.length,
+            bytes: bench.corpus.reduce((s, c) => s + c.file.size, 0)
+        },
+        results
+    };
+}
+
+// --- Kernels ---
+
+const KERNEL_FORMATS = ['jpeg', 'webp', 'png'];
+
+// Canvas variants a kernel can run on
+const VARIANTS = {
+    canvas: (w, h) => Object.assign(document.createElement('canvas'), { width: w, height: h }),
+    offscreen: (w, h) => new OffscreenCanvas(w, h)
+};
+
+/**
+ * Deterministic test image: smooth gradients plus seeded noise, so both the predictable and the
+ * high-entropy paths of the encoders are exercised and runs are comparable across machines.
+ */
+function syntheticImage(width, height, seed = 1) {
+    const img = new ImageData(width, height);
+    const d = img.data;
+    let x = seed;
+    for (let i = 0, p = 0; p < width * height; p++, i += 4) {
+        x ^= x << 13; x ^= x >>> 17; x ^= x << 5;   // xorshift32
+        const noise = (x & 31) - 16;
+        const px = p % width, py = (p / width) | 0;
+        d[i] = (px * 255 / width + noise) & 255;
+        d[i + 1] = (py * 255 / height + noise) & 255;
+        d[i + 2] = ((px + py) * 127 / width) & 255;
+        d[i + 3] = 255;
+    }
+    return img;
+}
+
+/**
+ * Runs fn (sync or async) until at least minSamples samples and minTimeMs have been collected,
+ * after warmup runs. Median and median absolute deviation are robust to GC and scheduling outliers.
+ */
+async function measure(fn, { warmup = 3, minSamples = 10, minTimeMs = 300 } = {}) {
+    for (let i = 0; i < warmup; i++) await fn();
+
+    const samples = [];
+    const start = performance.now();
+    while (samples.length < minSamples || performance.now() - start < minTimeMs) {
+        const t = performance.now();
+        await fn();
+        samples.push(performance.now() - t);
+    }
+
+    const median = (v) => { const s = [...v].sort((a, b) => a - b); return s[Math.floor(s.length / 2)]; };
+    const m = median(samples);
+    return { median: m, mad: median(samples.map(v => Math.abs(v - m))), samples: samples.length };
+}
+
+async function runKernels() {
+    const sizes = els.kernelSizes.value.split(',').map(s => parseInt(s)).filter(n => n > 0);
+    const rows = [];
+    els.btnRunKernels.disabled = true;
+
+    const add = async (kernel, variant, size, fn) => {
+        setStatus(`Kernel ${kernel} ${variant} ${size}px...`);
+        await new Promise(r => setTimeout(r)); // Let the status paint between kernels
+        const m = await measure(fn);
+        rows.push({ kernel, variant, size, ...m, nsPerPixel: m.median * 1e6 / (size * size) });
+        bench.kernelReport = { version: REPORT_VERSION, date: new Date().toISOString(), userAgent: navigator.userAgent, kernels: rows };
+        renderKernels();
+    };
+
+    for (const size of sizes) {
+        const source = syntheticImage(size, size);
+        const other = syntheticImage(size, size, 2);
+
+        await add('alpha scan', 'js', size, () => isOpaque(source));
+        await add('psnr', 'js', size, () => psnr(source, other));
+
+        for (const [variant, make] of Object.entries(VARIANTS)) {
+            const canvas = make(size, size);
+            const ctx = canvas.getContext('2d');
+            ctx.putImageData(source, 0, 0);
+            const bitmap = await createImageBitmap(source);
+            const target = make(size, size).getContext('2d');
+
+            // Reading one pixel back forces the draw to complete
+            await add('raster', variant, size, () => { target.drawImage(bitmap, 0, 0); target.getImageData(0, 0, 1, 1); });
+            await add('readback', variant, size, () => ctx.getImageData(0, 0, size, size));
+
+            for (const format of KERNEL_FORMATS) {
+                await add(`encode ${format}`, variant, size, () => canvasToBlob(canvas, mimeFor(format), 0.75));
+            }
+            bitmap.close();
+        }
+
+        const sourceCanvas = VARIANTS.offscreen(size, size);
+        sourceCanvas.getContext('2d').putImageData(source, 0, 0);
+        for (const format of KERNEL_FORMATS) {
+            const encoded = await canvasToBlob(sourceCanvas, mimeFor(format), 0.75);
+            await add(`decode ${format}`, 'bitmap', size, async () => (await decodeImage(encoded)).close());
+        }
+    }
+
+    els.btnRunKernels.disabled = false;
+    els.btnExportKernels.disabled = false;
+    setStatus(`Done: ${rows.length} kernel measurements.`);
+}
+
+// --- Rate-Distortion ---
+
+/**
+ * Sweeps quality for every configuration ("format/effort") over the corpus and reports
+ * bits per pixel against the chosen metric, plus the Bjøntegaard delta rate of each configuration
+ * against the first one. Encodes and metrics run on the worker pool; results are cached per
+ * (image, setting) so repeated sweeps only compute what changed. Effort defaults to fast: above it the
+ * encoder may hand back the original file, which is no point on the curve and is left out of both axes.
+ */
+async function runRd() {
+    const configs = els.rdConfigs.value.split(',').map(s => s.trim()).filter(Boolean).map(c => {
+        const [format, effort = 'fast'] = c.split('/');
+        return { name: c, format, effort };
+    });
+    const qualities = els.rdQualities.value.split(',').map(s => parseInt(s)).filter(q => q > 0 && q <= 100).sort((a, b) => a - b);
+    const metric = els.rdMetric.value;
+
+    els.btnRunRd.disabled = true;
+    startWorkers(Math.max(1, parseInt(els.benchWorkers.value) || 1));
+    try {
+        await sweepRd(configs, qualities, metric);
+    } catch (err) {
+        setStatus(`Rate-distortion failed: ${err.message || err}`);
+    } finally {
+        stopWorkers();
+        els.btnRunRd.disabled = false;
+    }
+}
+
+async function sweepRd(configs, qualities, metric) {
+    const tasks = [];
+    for (const config of configs) {
+        for (const quality of qualities) {
+            for (const c of bench.corpus) tasks.push({ config, quality, c });
+        }
+    }
+
+    let done = 0;
+    const failed = new Set(); // Corpus images that can't be decoded or encoded, left out of every curve
+    const points = await Promise.all(tasks.map(async ({ config, quality, c }) => {
+        const key = `${c.hash}|${config.format}|${quality}|${config.effort}`;
+        if (!bench.rdCache.has(key)) {
+            try {
+                const out = await runInWorker({ file: c.file, format: config.format, quality, effort: config.effort });
+                // Ahead of the encodes still waiting, so each encoded blob is measured and dropped right away
+                const m = await runInWorker({ type: 'metric', original: c.file, encoded: out.blob, priority: -1 });
+                // Same type and size as the input: balanced/max kept the original bytes instead of the encode
+                const original = c.file.type === mimeFor(config.format) && out.blob.size === c.file.size;
+                bench.rdCache.set(key, { bytes: out.blob.size, pixels: out.width * out.height, psnr: m.psnr, ssim: m.ssim, original });
+            } catch (err) {
+                failed.add(c);
+                return null;
+            }
+        }
+        if (++done % 10 === 0) setStatus(`Rate-distortion: ${done}/${tasks.length}`);
+        return { image: c, config: config.name, quality, ...bench.rdCache.get(key) };
+    }));
+
+    // One curve point per (config, quality): total bits over total pixels against mean quality
+    const curves = configs.map(config => ({
+        config: config.name,
+        points: qualities.map(quality => {
+            const p = points.filter(x => x && !failed.has(x.image) && x.config === config.name && x.quality === quality && !x.original);
+            const bytes = p.reduce((s, x) => s + x.bytes, 0);
+            const pixels = p.reduce((s, x) => s + x.pixels, 0);
+            const finite = p.map(x => distortion(x, metric)).filter(isFinite);
+            return {
+                quality,
+                bytes,
+                bpp: bytes * 8 / pixels,
+                value: finite.reduce((s, v) => s + v, 0) / finite.length
+            };
+        }).filter(pt => pt.bytes > 0) // Every image kept its original at this quality
+    }));
+    curves.forEach(c => c.bdRate = c === curves[0] ? 0 : bdRate(curves[0].points, c.points));
+
+    bench.rdReport = {
+        version: REPORT_VERSION,
+        date: new Date().toISOString(),
+        corpus: { id: bench.corpusId, images: bench.corpus.length, failed: failed.size },
+        metric,
+        reference: curves[0]?.config,
+        curves
+    };
+    renderRd();
+    els.btnExportRd.disabled = false;
+    setStatus(`Rate-distortion done: ${tasks.length} encodes (${bench.rdCache.size} cached)${failed.size ? `, skipped ${failed.size} images that could not be encoded` : ''}.`);
+}
+
+// Quality axis in dB for both metrics: SSIM is mapped to -10 log10(1 - SSIM) so its curve isn't flat near 1
+function distortion(point, metric) {
+    return metric === 'ssim' ? -10 * Math.log10(1 - point.ssim) : point.psnr;
+}
+
+/**
+ * Bjøntegaard delta rate in percent: average bitrate difference of `test` against `ref` at equal quality.
+ * Fits log(rate) as a cubic in quality for both curves and integrates over the overlapping quality range.
+ * Negative means `test` needs fewer bits. null when the curves don't overlap or have fewer than 4 points.
+ */
+function bdRate(ref, test) {
+    const usable = (pts) => pts.filter(p => isFinite(p.value) && p.bpp > 0);
+    const a = usable(ref), b = usable(test);
+    if (a.length < 4 || b.length < 4) return null;
+
+    const lo = Math.max(Math.min(...a.map(p => p.value)), Math.min(...b.map(p => p.value)));
+    const hi = Math.min(Math.max(...a.map(p => p.value)), Math.max(...b.map(p => p.value)));
+    if (hi <= lo) return null;
+
+    // Quality is shifted to start at 0 to keep the normal equations well conditioned
+    const integral = (pts) => {
+        const c = polyfit(pts.map(p => p.value - lo), pts.map(p => Math.log(p.bpp)), 3);
+        const F = (x) => c.reduce((s, ci, i) => s + ci * x ** (i + 1) / (i + 1), 0);
+        return F(hi - lo);
+    };
+    return (Math.exp((integral(b) - integral(a)) / (hi - lo)) - 1) * 100;
+}
+
+// Least-squares polynomial fit via normal equations, coefficients lowest order first
+function polyfit(xs, ys, degree) {
+    const n = degree + 1;
+    const A = Array.from({ length: n }, () => new Array(n + 1).fill(0));
+    for (let k = 0; k < xs.length; k++) {
+        for (let i = 0; i < n; i++) {
+            for (let j = 0; j < n; j++) A[i][j] += xs[k] ** (i + j);
+            A[i][n] += ys[k] * xs[k] ** i;
+        }
+    }
+    // Gaussian elimination with partial pivoting
+    for (let col = 0; col < n; col++) {
+        let pivot = col;
+        for (let r = col + 1; r < n; r++) if (Math.abs(A[r][col]) > Math.abs(A[pivot][col])) pivot = r;
+        [A[col], A[pivot]] = [A[pivot], A[col]];
+        for (let r = 0; r < n; r++) {
+            if (r === col) continue;
+            const f = A[r][col] / A[col][col];
+            for (let c = col; c <= n; c++) A[r][c] -= f * A[col][c];
+        }
+    }
+    return A.map((row, i) => row[n] / row[i]);
+}
+
+// --- Load ---
+
+// Requests still waiting for a response beyond this are dropped and counted, so the page stays responsive
+const LOAD_MAX_OUTSTANDING = 2000;
+
+/**
+ * Open-loop load against the transform proxy: request i is due at start + i / rate whatever happened
+ * to earlier ones. Latency runs from the due time (coordinated omission corrected); service time from
+ * the actual send. Percentiles are reported overall and per X-Velo-Cache status.
+ */
+async function runLoad() {
+    const urls = els.loadUrls.value.split('\n').map(s => s.trim()).filter(Boolean);
+    const rate = Math.max(1, parseFloat(els.loadRate.value) || 1);
+    const durationMs = Math.max(1, parseFloat(els.loadDuration.value) || 1) * 1000;
+    if (urls.length === 0) return setStatus('Load: no URLs.');
+    if (!navigator.serviceWorker || !navigator.serviceWorker.controller) {
+        return setStatus('Load: this page is not controlled by the service worker, open the app once and reload.');
+    }
+
+    els.btnRunLoad.disabled = true;
+    const total = Math.floor(durationMs / 1000 * rate);
+    const samples = [];  // { latency, service, cache }
+    let errors = 0, dropped = 0, outstanding = 0, sent = 0;
+    const pending = [];
+
+    const send = async (url, due) => {
+        outstanding++;
+        const sentAt = performance.now();
+        try {
+            const res = await fetch(url, { cache: 'no-store' });
+            await res.blob();
+            const end = performance.now();
+            if (!res.ok) errors++;
+            else samples.push({ latency: end - due, service: end - sentAt, cache: res.headers.get('X-Velo-Cache') || 'none' });
+        } catch (err) {
+            errors++;
+        } finally {
+            outstanding--;
+        }
+    };
+
+    const start = performance.now();
+    while (sent < total) {
+        // Fire everything that is due; a late timer sends a burst rather than shifting the schedule
+        const now = performance.now();
+        while (sent < total && start + sent * 1000 / rate <= now) {
+            const due = start + sent * 1000 / rate;
+            if (outstanding >= LOAD_MAX_OUTSTANDING) dropped++;
+            else pending.push(send(new URL(urls[sent % urls.length], location.href).href, due));
+            sent++;
+        }
+        setStatus(`Load: ${sent}/${total} sent, ${outstanding} outstanding`);
+        if (sent < total) await new Promise(r => setTimeout(r, Math.max(0, start + sent * 1000 / rate - performance.now())));
+    }
+    await Promise.all(pending);
+    const elapsedMs = performance.now() - start;
+
+    const summarize = (cache, list) => {
+        const sorted = list.map(s => s.latency).sort((a, b) => a - b);
+        const service = list.map(s => s.service).sort((a, b) => a - b);
+        const at = (arr, q) => arr.length ? arr[Math.min(arr.length - 1, Math.ceil(q * arr.length) - 1)] : null;
+        return {
+            cache,
+            requests: list.length,
+            p50: at(sorted, 0.5), p90: at(sorted, 0.9), p99: at(sorted, 0.99), p999: at(sorted, 0.999),
+            max: at(sorted, 1),
+            serviceP50: at(service, 0.5), serviceP99: at(service, 0.99)
+        };
+    };
+    const statuses = [...new Set(samples.map(s => s.cache))].sort();
+
+    bench.loadReport = {
+        version: REPORT_VERSION,
+        date: new Date().toISOString(),
+        userAgent: navigator.userAgent,
+        rate,
+        durationMs,
+        urls,
+        sent: total,
+        ok: samples.length,
+        errors,
+        dropped,
+        errorRate: total ? (errors + dropped) / total : 0,
+        throughput: samples.length / (elapsedMs / 1000),
+        latency: [summarize('all', samples), ...statuses.map(c => summarize(c, samples.filter(s => s.cache === c)))]
+    };
+    renderLoad();
+    els.btnRunLoad.disabled = false;
+    els.btnExportLoad.disabled = false;
+    const r = bench.loadReport;
+    setStatus(`Load done: ${r.ok}/${r.sent} ok, ${r.errors} errors, ${r.dropped} dropped, ${r.throughput.toFixed(1)} req/s (target ${rate}).`);
+}
+
+// --- Rendering ---
+
+function renderResults() {
+    if (!els.resultsBody || !bench.report) return;
+    const base = new Map((bench.baseline?.results || []).map(r => [r.key, r]));
+
+    // Relative change against the baseline; `worse` says which direction is a regression
+    const delta = (value, old, worse) => {
+        if (old === undefined || old === null || value === null) return '';
+        const pct = (value / old - 1) * 100;
+        const bad = worse > 0 ? pct > 1 : pct < -5;
+        return ` <span class="${bad ? 'text-danger' : 'text-white-50'}">(${pct >= 0 ? '+' : ''}${pct.toFixed(1)}%)</span>`;
+    };
+
+    els.resultsBody.innerHTML = bench.report.results.map(r => {
+        const b = base.get(r.key) || {};
+        return `
+            <tr>
+                <td>${r.key}${r.failed ? ` <span class="text-warning">(${r.failed} skipped)</span>` : ''}</td>
+                <td>${r.imagesPerSecond.toFixed(2)}${delta(r.imagesPerSecond, b.imagesPerSecond, -1)}</td>
+                <td>${r.megapixelsPerSecond.toFixed(2)}${delta(r.megapixelsPerSecond, b.megapixelsPerSecond, -1)}</td>
+                <td>${formatSize(r.bytesIn)}</td>
+                <td>${formatSize(r.bytesOut)}${delta(r.bytesOut, b.bytesOut, 1)}</td>
+                <td>${r.ratio.toFixed(3)}</td>
+                <td>${r.psnr === null ? '-' : r.psnr.toFixed(2)}${b.psnr && r.psnr !== null ? ` <span class="text-white-50">(${(r.psnr - b.psnr).toFixed(2)})</span>` : ''}</td>
+                <td>${r.peakPageHeap == null ? '-' : formatSize(r.peakPageHeap)}</td>
+            </tr>`;
+    }).join('');
+}
+
+function renderKernels() {
+    if (!els.kernelsBody || !bench.kernelReport) return;
+    els.kernelsBody.innerHTML = bench.kernelReport.kernels.map(k => `
+        <tr>
+            <td>${k.kernel}</td>
+            <td>${k.variant}</td>
+            <td>${k.size}</td>
+            <td>${k.median.toFixed(3)}</td>
+            <td>${k.mad.toFixed(3)}</td>
+            <td>${k.nsPerPixel.toFixed(2)}</td>
+            <td>${k.samples}</td>
+        </tr>`).join('');
+}
+
+function renderRd() {
+    if (!els.rdBody || !bench.rdReport) return;
+    els.rdBody.innerHTML = bench.rdReport.curves.map(c => `
+        <tr>
+            <td>${c.config}${c.config === bench.rdReport.reference ? ' <span class="text-white-50">(ref)</span>' : ''}</td>
+            <td>${c.bdRate === null ? 'n/a' : `${c.bdRate >= 0 ? '+' : ''}${c.bdRate.toFixed(2)}%`}</td>
+            <td>${c.points.map(p => `q${p.quality}: ${p.bpp.toFixed(3)} bpp / ${p.value.toFixed(2)} dB`).join('<br>')}</td>
+        </tr>`).join('');
+}
+
+function renderLoad() {
+    if (!els.loadBody || !bench.loadReport) return;
+    const ms = v => v === null ? '-' : v.toFixed(1);
+    els.loadBody.innerHTML = bench.loadReport.latency.map(l => `
+        <tr>
+            <td>${l.cache}</td>
+            <td>${l.requests}</td>
+            <td>${ms(l.p50)}</td>
+            <td>${ms(l.p90)}</td>
+            <td>${ms(l.p99)}</td>
+            <td>${ms(l.p999)}</td>
+            <td>${ms(l.max)}</td>
+        </tr>`).join('');
+}
+
+// --- Utilities ---
+
+function setStatus(text) {
+    if(els.benchStatus) els.benchStatus.textContent = text;
+}
+
+function formatSize(bytes) {
+    if (bytes === 0) return '0 B';
+    const k = 1024;
+    const sizes = ['B', 'KB', 'MB', 'GB'];
+    const i = Math.floor(Math.log(bytes) / Math.log(k));
+    return parseFloat((bytes / Math.pow(k, i)).toFixed(1)) + ' ' + sizes[i];
+}
+
+function downloadJson(data, name) {
+    const blob = new Blob([JSON.stringify(data, null, 2)], { type: 'application/json' });
+    const a = document.createElement('a');
+    a.href = URL.createObjectURL(blob);
+    a.download = name;
+    document.body.appendChild(a);
+    a.click();
+    document.body.removeChild(a);
+    URL.revokeObjectURL(a.href);
+}
@@ -0,0 +1,354 @@
+/**
+ * VELO - Codec
+ * Decode/encode pipeline shared by the page and the encoder workers.
+ * Uses OffscreenCanvas when available, a DOM canvas otherwise.
+ */
+
+function mimeFor(format) {
+    return `image/${format === 'jpg' ? 'jpeg' : format}`;
+}
+
+function createCanvas(width, height) {
+    if (typeof OffscreenCanvas !== 'undefined') return new OffscreenCanvas(width, height);
+    const canvas = document.createElement('canvas');
+    canvas.width = width;
+    canvas.height = height;
+    return canvas;
+}
+
+// --- Headers ---
+
+// Enough for the size of a JPEG behind a large EXIF/ICC segment; other formats need < 32 bytes
+const HEADER_READ_AHEAD = 64 * 1024;
+
+/**
+ * Reads the pixel dimensions from the file header without decoding the image.
+ * Supports PNG, GIF, WebP (VP8, VP8L, VP8X) and JPEG. Resolves to { width, height } or null.
+ */
+async function readImageSize(file) {
+    const v = new DataView(await file.slice(0, HEADER_READ_AHEAD).arrayBuffer());
+    const ascii = (o, n) => String.fromCharCode(...new Uint8Array(v.buffer, o, n));
+    if (v.byteLength < 30) return null;
+
+    if (v.getUint32(0) === 0x89504E47) {
+        return { width: v.getUint32(16), height: v.getUint32(20) };
+    }
+    if (ascii(0, 4) === 'GIF8') {
+        return { width: v.getUint16(6, true), height: v.getUint16(8, true) };
+    }
+    if (ascii(0, 4) === 'RIFF' && ascii(8, 4) === 'WEBP') {
+        const chunk = ascii(12, 4);
+        if (chunk === 'VP8 ') return { width: v.getUint16(26, true) & 0x3FFF, height: v.getUint16(28, true) & 0x3FFF };
+        if (chunk === 'VP8L') {
+            const bits = v.getUint32(21, true);
+            return { width: (bits & 0x3FFF) + 1, height: ((bits >>> 14) & 0x3FFF) + 1 };
+        }
+        if (chunk === 'VP8X') {
+            const u24 = (o) => v.getUint8(o) | (v.getUint8(o + 1) << 8) | (v.getUint8(o + 2) << 16);
+            return { width: u24(24) + 1, height: u24(27) + 1 };
+        }
+        return null;
+    }
+    if (v.getUint16(0) === 0xFFD8) {
+        // Walk the marker segments up to the first start-of-frame
+        let o = 2;
+        while (o + 9 < v.byteLength && v.getUint8(o) === 0xFF) {
+            const marker = v.getUint8(o + 1);
+            if (marker >= 0xC0 && marker <= 0xCF && marker !== 0xC4 && marker !== 0xC8 && marker !== 0xCC) {
+                return { width: v.getUint16(o + 7), height: v.getUint16(o + 5) };
+            }
+            o += 2 + v.getUint16(o + 2);
+        }
+    }
+    return null;
+}
+
+// --- Canvas Pool ---
+// Canvases (and their 2D contexts) are reused across jobs instead of reallocating a backing store per
+// image: batches are mostly images of a few distinct sizes. Free canvases are keyed by size and alpha,
+// and the least recently released sizes are dropped once the pool holds more than its share of
+// CANVAS_POOL_BYTES, a budget for all threads together (see setCanvasPoolThreads).
+
+const CANVAS_POOL_BYTES = 256 * 1024 * 1024;
+
+const canvasPool = {
+    free: new Map(),    // "WxH/alpha" -> [{ canvas, ctx, bytes }], oldest key first
+    maxBytes: CANVAS_POOL_BYTES, // This thread's share
+    pooledBytes: 0,
+    liveBytes: 0,       // Acquired and not yet released
+    peakBytes: 0,       // Peak of live + pooled
+    hits: 0,
+    misses: 0,
+    evictions: 0
+};
+
+function acquireCanvas(width, height, alpha = true) {
+    const key = `${width}x${height}/${alpha ? 'a' : 'o'}`;
+    const list = canvasPool.free.get(key);
+    let entry;
+
+    if (list && list.length > 0) {
+        entry = list.pop();
+        if (list.length === 0) canvasPool.free.delete(key);
+        canvasPool.pooledBytes -= entry.bytes;
+        canvasPool.hits++;
+        if (alpha) entry.ctx.clearRect(0, 0, width, height); // Transparent pixels must not show the previous image
+    } else {
+        const canvas = createCanvas(width, height);
+        entry = { key, canvas, ctx: canvas.getContext('2d', { alpha }), bytes: width * height * 4 };
+        canvasPool.misses++;
+    }
+
+    canvasPool.liveBytes += entry.bytes;
+    canvasPool.peakBytes = Math.max(canvasPool.peakBytes, canvasPool.liveBytes + canvasPool.pooledBytes);
+    return entry;
+}
+
+function releaseCanvas(entry) {
+    canvasPool.liveBytes -= entry.bytes;
+
+    // Re-inserting moves the key to the end, so iteration order is least recently used first
+    const list = canvasPool.free.get(entry.key) || [];
+    canvasPool.free.delete(entry.key);
+    list.push(entry);
+    canvasPool.free.set(entry.key, list);
+    canvasPool.pooledBytes += entry.bytes;
+    trimCanvasPool(canvasPool.maxBytes);
+}
+
+// Drops the least recently released canvases until at most maxBytes are pooled (all of them by default)
+function trimCanvasPool(maxBytes = 0) {
+    for (const [key, oldest] of canvasPool.free) {
+        if (canvasPool.pooledBytes <= maxBytes) break;
+        while (oldest.length > 0 && canvasPool.pooledBytes > maxBytes) {
+            const dropped = oldest.shift();
+            canvasPool.pooledBytes -= dropped.bytes;
+            canvasPool.evictions++;
+            // Shrinking frees the backing store now instead of at the next GC
+            dropped.canvas.width = dropped.canvas.height = 0;
+        }
+        if (oldest.length === 0) canvasPool.free.delete(key);
+    }
+}
+
+// Splits CANVAS_POOL_BYTES evenly between the threads of a pool, so memory doesn't grow with its size
+function setCanvasPoolThreads(threads) {
+    canvasPool.maxBytes = CANVAS_POOL_BYTES / Math.max(1, threads);
+    trimCanvasPool(canvasPool.maxBytes);
+}
+
+function canvasPoolStats() {
+    const { pooledBytes, liveBytes, peakBytes, hits, misses, evictions } = canvasPool;
+    return { pooledBytes, liveBytes, peakBytes, hits, misses, evictions };
+}
+
+function canvasToBlob(canvas, mimeType, quality) {
+    if (canvas.convertToBlob) return canvas.convertToBlob({ type: mimeType, quality });
+    return new Promise((resolve, reject) => canvas.toBlob(b => b ? resolve(b) : reject(new Error('Encoding failed')), mimeType, quality));
+}
+
+// ImageBitmap where supported, an <img> element on older browsers (page only)
+async function decodeImage(file) {
+    if (typeof createImageBitmap !== 'undefined') return createImageBitmap(file);
+
+    const img = new Image();
+    img.src = URL.createObjectURL(file);
+    try {
+        await new Promise((resolve, reject) => { img.onload = resolve; img.onerror = reject; });
+    } finally {
+        URL.revokeObjectURL(img.src);
+    }
+    return img;
+}
+
+// Browsers without an encoder for a type silently fall back to PNG, so check what actually comes out
+async function probeEncoder(format) {
+    const canvas = createCanvas(1, 1);
+    canvas.getContext('2d').fillRect(0, 0, 1, 1);
+    const blob = await canvasToBlob(canvas, mimeFor(format), 0.5);
+    return blob.type === mimeFor(format);
+}
+
+function isOpaque(imageData) {
+    const data = imageData.data;
+    for (let i = 3; i < data.length; i += 4) {
+        if (data[i] !== 255) return false;
+    }
+    return true;
+}
+
+// Starts decoding, resolves to { bitmap, t0, t1 } with the decode start and end times
+function startDecode(file) {
+    const t0 = performance.now();
+    const decoding = decodeImage(file).then(bitmap => ({ bitmap, t0, t1: performance.now() }));
+    decoding.catch(() => {}); // Reported by whoever awaits it, not as an unhandled rejection
+    return decoding;
+}
+
+/**
+ * Compresses an image blob. Effort tiers (see EFFORT in app.js):
+ *  fast:     single encode with the requested settings
+ *  balanced: also keeps the original bytes when re-encoding in the same format makes the file bigger;
+ *            the original's metadata (EXIF, GPS) is kept with them, which is why fast is the default
+ *  max:      also scans for transparency and re-encodes opaque images without an alpha channel
+ * Resolves to { blob, width, height, timings, starts } with per-stage durations in ms and per-stage
+ * wall-clock starts (ms since epoch), so stages from different threads can be aligned. Stages don't
+ * necessarily run back to back: a prefetched decode can finish long before its raster starts.
+ * `width`/`height`, when given, bound the output size: the image is scaled down to fit, never up.
+ * Canvases come from the canvas pool and go back to it before the promise settles.
+ * `decoding` can be a startDecode(file) begun earlier, to overlap decoding with a previous encode.
+ */
+async function encodeImage(file, { format, quality, effort = 'fast', width: maxWidth, height: maxHeight }, decoding = startDecode(file)) {
+    const { bitmap, t0, t1 } = await decoding;
+    const rasterStart = performance.now(); // Not t1: a prefetched decode may have waited behind another encode
+    const scale = Math.min(1, maxWidth ? maxWidth / bitmap.width : 1, maxHeight ? maxHeight / bitmap.height : 1);
+    const width = Math.max(1, Math.round(bitmap.width * scale));
+    const height = Math.max(1, Math.round(bitmap.height * scale));
+    const draw = (ctx) => {
+        ctx.imageSmoothingQuality = 'high';
+        ctx.drawImage(bitmap, 0, 0, width, height);
+    };
+
+    // Canvases acquired by this job, all returned to the pool when it ends
+    const acquired = [];
+    const acquire = (alpha) => { const entry = acquireCanvas(width, height, alpha); acquired.push(entry); return entry; };
+
+    try {
+        const { canvas, ctx } = acquire(true);
+        draw(ctx);
+        const t2 = performance.now();
+
+        const mimeType = mimeFor(format);
+        const encoding = canvasToBlob(canvas, mimeType, quality / 100);
+
+        // Opaque images don't need an alpha channel: encoding from an opaque canvas drops it.
+        // The scan and the second encode overlap the first encode instead of waiting for it.
+        let candidate = null;
+        if (effort === 'max' && mimeType !== 'image/jpeg' && isOpaque(ctx.getImageData(0, 0, width, height))) {
+            const opaque = acquire(false);
+            draw(opaque.ctx);
+            candidate = canvasToBlob(opaque.canvas, mimeType, quality / 100);
+        }
+
+        let blob = await encoding;
+        if (candidate) {
+            const alt = await candidate;
+            if (alt.size < blob.size) blob = alt;
+        }
+
+        // Re-encoding in the same format can grow already optimized files: keep the original then
+        if (effort !== 'fast' && scale === 1 && file.type === mimeType && file.size <= blob.size) blob = file;
+
+        const timings = { decode: t1 - t0, raster: t2 - rasterStart, encode: performance.now() - t2 };
+        const at = (t) => performance.timeOrigin + t;
+        return { blob, width, height, timings, starts: { decode: at(t0), raster: at(rasterStart), encode: at(t2) } };
+    } finally {
+        acquired.forEach(releaseCanvas);
+        if (bitmap.close) bitmap.close();
+    }
+}
+
+// --- Metrics ---
+
+// Decodes a blob to RGBA pixels
+async function decodePixels(blob) {
+    const bitmap = await decodeImage(blob);
+    try {
+        const canvas = createCanvas(bitmap.width, bitmap.height);
+        const ctx = canvas.getContext('2d');
+        ctx.drawImage(bitmap, 0, 0);
+        return ctx.getImageData(0, 0, bitmap.width, bitmap.height);
+    } finally {
+        if (bitmap.close) bitmap.close();
+    }
+}
+
+// Peak signal-to-noise ratio over RGB in dB, Infinity for identical images
+function psnr(a, b) {
+    if (a.width !== b.width || a.height !== b.height) throw new Error('Image sizes differ');
+    const da = a.data, db = b.data;
+    let sum = 0;
+    for (let i = 0; i < da.length; i += 4) {
+        const dr = da[i] - db[i], dg = da[i + 1] - db[i + 1], dbl = da[i + 2] - db[i + 2];
+        sum += dr * dr + dg * dg + dbl * dbl;
+    }
+    const mse = sum / (a.width * a.height * 3);
+    return mse === 0 ? Infinity : 10 * Math.log10(255 * 255 / mse);
+}
+
+/**
+ * Structural similarity on luma (BT.601), averaged over 8x8 windows with a stride of 4.
+ * 1 for identical images.
+ */
+function ssim(a, b) {
+    if (a.width !== b.width || a.height !== b.height) throw new Error('Image sizes differ');
+    const { width, height } = a;
+    const la = luma(a), lb = luma(b);
+    const C1 = (0.01 * 255) ** 2, C2 = (0.03 * 255) ** 2;
+    const W = 8, STRIDE = 4, N = W * W;
+
+    let sum = 0, windows = 0;
+    for (let y = 0; y + W <= height; y += STRIDE) {
+        for (let x = 0; x + W <= width; x += STRIDE) {
+            let sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+            for (let j = 0; j < W; j++) {
+                let i = (y + j) * width + x;
+                for (let k = 0; k < W; k++, i++) {
+                    const va = la[i], vb = lb[i];
+                    sa += va; sb += vb;
+                    saa += va * va; sbb += vb * vb; sab += va * vb;
+                }
+            }
+            const ma = sa / N, mb = sb / N;
+            const varA = saa / N - ma * ma, varB = sbb / N - mb * mb, cov = sab / N - ma * mb;
+            sum += ((2 * ma * mb + C1) * (2 * cov + C2)) / ((ma * ma + mb * mb + C1) * (varA + varB + C2));
+            windows++;
+        }
+    }
+    return windows > 0 ? sum / windows : 1;
+}
+
+function luma(imageData) {
+    const d = imageData.data;
+    const out = new Float32Array(imageData.width * imageData.height);
+    for (let i = 0, p = 0; p < out.length; p++, i += 4) {
+        out[p] = 0.299 * d[i] + 0.587 * d[i + 1] + 0.114 * d[i + 2];
+    }
+    return out;
+}
+
+// --- Histograms ---
+
+// Log-bucketed latency histograms (HDR-style): 8 buckets per power of two from 1 µs up to ~70 min,
+// so any recorded value is off by at most 9%. Recording is one log2 and an increment.
+const HISTOGRAM_SUB_BUCKETS = 8;
+const HISTOGRAM_BUCKETS = 32 * HISTOGRAM_SUB_BUCKETS;
+
+function createHistogram() {
+    return { counts: new Uint32Array(HISTOGRAM_BUCKETS), sum: 0, count: 0 };
+}
+
+// Histogram for `key` in a { key: histogram } map, created on first use
+function histogramFor(map, key) {
+    return map[key] || (map[key] = createHistogram());
+}
+
+function recordValue(histogram, ms) {
+    const us = Math.max(1, ms * 1000);
+    const i = Math.min(HISTOGRAM_BUCKETS - 1, Math.floor(Math.log2(us) * HISTOGRAM_SUB_BUCKETS));
+    histogram.counts[i]++;
+    histogram.sum += ms;
+    histogram.count++;
+}
+
+// Upper bound of bucket i in ms
+function bucketUpperBound(i) {
+    return Math.pow(2, (i + 1) / HISTOGRAM_SUB_BUCKETS) / 1000;
+}
+
+function mergeHistogram(into, histogram) {
+    for (let i = 0; i < HISTOGRAM_BUCKETS; i++) into.counts[i] += histogram.counts[i];
+    into.sum += histogram.sum;
+    into.count += histogram.count;
+    return into;
+}
@@ -0,0 +1,237 @@
+/**
+ * VELO - Result Store
+ * Persists optimized outputs in IndexedDB so images that were already processed with the same
+ * settings are not encoded again, across reloads, interrupted batches and (via export/import) hosts.
+ * Persistence is opt-in: the app only reads and writes here once the user turns on "Keep results on
+ * this device", and turning it off clears the store.
+ *
+ * Two object stores:
+ *  results:  content-addressed, `${SHA-256 of input}:${settings}` -> optimized bytes. Size bounded,
+ *            least recently used entries are compacted away first.
+ *  manifest: file identity (name, size, mtime) plus settings -> results key, so unchanged files are
+ *            found with a single get and without hashing. Writing a result for a file drops its
+ *            entries for other settings.
+ */
+
+const STORE_DB = 'velo';
+const STORE_VERSION = 2;
+const STORE_MAX_BYTES = 512 * 1024 * 1024;
+const ACCESS_RESOLUTION_MS = 60 * 1000; // lastAccess is only rewritten when older than this
+const STORE_KEY = /^[0-9a-f]{64}:[a-z]+\/q\d{1,3}\/(fast|balanced|max)(\/\d+x\d+)?$/; // See settingsKey
+const STORE_TYPE = /^image\/(jpeg|png|webp|avif)$/;
+
+let storeDb = null;
+let storeBytes = null; // Total size of `results`, counted on first compaction
+
+function openStore() {
+    if (!storeDb) {
+        storeDb = new Promise((resolve, reject) => {
+            const req = indexedDB.open(STORE_DB, STORE_VERSION);
+            req.onupgradeneeded = (e) => {
+                const db = req.result;
+                // Version 1 manifest entries held the bytes themselves: start over
+                if (e.oldVersion === 1) db.deleteObjectStore('manifest');
+                const manifest = db.createObjectStore('manifest', { keyPath: 'key' });
+                manifest.createIndex('file', 'file');
+                const results = db.createObjectStore('results', { keyPath: 'key' });
+                results.createIndex('lastAccess', 'lastAccess');
+            };
+            req.onsuccess = () => resolve(req.result);
+            req.onerror = () => reject(req.error);
+        });
+        storeDb.catch(() => storeDb = null);
+    }
+    return storeDb;
+}
+
+function idb(req) {
+    return new Promise((resolve, reject) => {
+        req.onsuccess = () => resolve(req.result);
+        req.onerror = () => reject(req.error);
+    });
+}
+
+function txDone(tx) {
+    return new Promise((resolve, reject) => { tx.oncomplete = resolve; tx.onerror = () => reject(tx.error); tx.onabort = () => reject(tx.error); });
+}
+
+function fileIdentity(file) {
+    return `${file.name}|${file.size}|${file.lastModified}`;
+}
+
+// Settings that change the output bytes
+function settingsKey({ format, quality, effort, width, height }) {
+    const size = width || height ? `/${width || 0}x${height || 0}` : '';
+    return `${format}/q${quality}/${effort}${size}`;
+}
+
+// Hashes are memoized per Blob: a new file is looked up and then saved, and must be read only once
+const contentHashes = new WeakMap();
+
+async function contentHash(blob) {
+    if (!contentHashes.has(blob)) contentHashes.set(blob, sha256Hex(blob));
+    return contentHashes.get(blob);
+}
+
+async function sha256Hex(blob) {
+    const digest = await crypto.subtle.digest('SHA-256', await blob.arrayBuffer());
+    return Array.from(new Uint8Array(digest), b => b.toString(16).padStart(2, '0')).join('');
+}
+
+/**
+ * Resolves to { blob, width, height } or null. Unchanged files are found through the manifest;
+ * otherwise the input is hashed, so renamed or copied files and imported results still hit.
+ * A hit refreshes the entry's lastAccess and records a manifest pointer, unless `readOnly`.
+ * Storage errors count as a miss.
+ */
+async function manifestGet(file, settings, { readOnly = false } = {}) {
+    try {
+        const db = await openStore();
+        const identity = `${fileIdentity(file)}|${settingsKey(settings)}`;
+        const pointer = await idb(db.transaction('manifest').objectStore('manifest').get(identity));
+
+        const key = pointer ? pointer.result : `${await contentHash(file)}:${settingsKey(settings)}`;
+        const entry = await idb(db.transaction('results').objectStore('results').get(key));
+        if (!entry) return null;
+        if (readOnly) return { blob: entry.blob, width: entry.width, height: entry.height };
+
+        const tx = db.transaction(['results', 'manifest'], 'readwrite');
+        if (Date.now() - entry.lastAccess > ACCESS_RESOLUTION_MS) tx.objectStore('results').put({ ...entry, lastAccess: Date.now() });
+        if (!pointer) putPointer(tx.objectStore('manifest'), file, settings, key);
+        await txDone(tx);
+
+        return { blob: entry.blob, width: entry.width, height: entry.height };
+    } catch (err) {
+        return null;
+    }
+}
+
+async function manifestPut(file, settings, { blob, width, height }) {
+    try {
+        const key = `${await contentHash(file)}:${settingsKey(settings)}`;
+        const db = await openStore();
+        const tx = db.transaction(['results', 'manifest'], 'readwrite');
+        const results = tx.objectStore('results');
+
+        const previous = await idb(results.get(key));
+        results.put({ key, blob, width, height, bytes: blob.size, lastAccess: Date.now() });
+        await putPointer(tx.objectStore('manifest'), file, settings, key);
+        await txDone(tx);
+
+        if (storeBytes !== null) storeBytes += blob.size - (previous ? previous.bytes : 0);
+        await compactStore();
+    } catch (err) {
+        console.warn('VELO: could not save result', err);
+    }
+}
+
+// Points the file's manifest entry at `key`; entries for other settings are no longer current
+async function putPointer(manifest, file, settings, key) {
+    const identity = fileIdentity(file);
+    const id = `${identity}|${settingsKey(settings)}`;
+    const stale = await idb(manifest.index('file').getAllKeys(identity));
+    stale.filter(k => k !== id).forEach(k => manifest.delete(k));
+    manifest.put({ key: id, file: identity, result: key });
+}
+
+/**
+ * Deletes least recently used results until the store fits STORE_MAX_BYTES. Manifest entries
+ * pointing at deleted results are left behind: they just miss on the next lookup.
+ */
+async function compactStore(maxBytes = STORE_MAX_BYTES) {
+    const db = await openStore();
+    if (storeBytes === null) storeBytes = (await storeStats()).bytes;
+    if (storeBytes <= maxBytes) return;
+
+    const tx = db.transaction('results', 'readwrite');
+    const req = tx.objectStore('results').index('lastAccess').openCursor();
+    req.onsuccess = () => {
+        const cursor = req.result;
+        if (!cursor || storeBytes <= maxBytes) return;
+        storeBytes -= cursor.value.bytes;
+        cursor.delete();
+        cursor.continue();
+    };
+    await txDone(tx);
+}
+
+// True when nothing is stored, e.g. because the user never opted in: callers can skip hashing
+async function storeEmpty() {
+    try {
+        const db = await openStore();
+        return !(await idb(db.transaction('results').objectStore('results').openKeyCursor()));
+    } catch (err) {
+        return true;
+    }
+}
+
+async function storeStats() {
+    const db = await openStore();
+    const tx = db.transaction('results');
+    let count = 0, bytes = 0;
+    const req = tx.objectStore('results').openCursor();
+    req.onsuccess = () => {
+        const cursor = req.result;
+        if (!cursor) return;
+        count++;
+        bytes += cursor.value.bytes;
+        cursor.continue();
+    };
+    await txDone(tx);
+    storeBytes = bytes;
+    return { count, bytes };
+}
+
+async function clearStore() {
+    const db = await openStore();
+    const tx = db.transaction(['results', 'manifest'], 'readwrite');
+    tx.objectStore('results').clear();
+    tx.objectStore('manifest').clear();
+    await txDone(tx);
+    storeBytes = 0;
+}
+
+// --- Import / Export ---
+// The portable form is a ZIP (JSZip must be loaded): index.json with the metadata, one file per result.
+// Only results are exported; manifests are host specific and rebuilt from content hashes on import.
+
+async function exportStore() {
+    const db = await openStore();
+    const entries = await idb(db.transaction('results').objectStore('results').getAll());
+    const zip = new JSZip();
+    const index = entries.map(({ key, width, height, bytes, lastAccess }, i) => {
+        zip.file(`results/${i}`, entries[i].blob);
+        return { key, width, height, bytes, lastAccess, file: `results/${i}`, type: entries[i].blob.type };
+    });
+    zip.file('index.json', JSON.stringify({ version: STORE_VERSION, results: index }));
+    return zip.generateAsync({ type: 'blob', compression: 'STORE' });
+}
+
+// Resolves to the number of results imported
+async function importStore(blob) {
+    const zip = await JSZip.loadAsync(blob);
+    const { results } = JSON.parse(await zip.file('index.json').async('string'));
+
+    // The archive is untrusted: entries that could not have come from exportStore are skipped, and
+    // sizes are taken from the data itself so compaction accounts for what is actually stored
+    const imported = [];
+    for (const r of results) {
+        const entry = typeof r.file === 'string' && zip.file(r.file);
+        if (!entry || !STORE_KEY.test(r.key) || !STORE_TYPE.test(r.type)) continue;
+        const data = await entry.async('blob');
+        imported.push({
+            key: r.key, blob: new Blob([data], { type: r.type }),
+            width: Number.isInteger(r.width) ? r.width : 0, height: Number.isInteger(r.height) ? r.height : 0,
+            bytes: data.size, lastAccess: Math.min(Number(r.lastAccess) || 0, Date.now())
+        });
+    }
+
+    const db = await openStore();
+    const tx = db.transaction('results', 'readwrite');
+    imported.forEach(r => tx.objectStore('results').put(r));
+    await txDone(tx);
+
+    storeBytes = null;
+    await compactStore();
+    return imported.length;
+}
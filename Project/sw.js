@@ -0,0 +1,406 @@
+/**
+ * VELO - Service Worker
+ * Precaches the app shell so repeat visits start from cache and work offline.
+ * Bump CACHE_NAME whenever the precache list changes.
+ * Also serves imgproxy-style transform URLs (see Transform Proxy) with the page's encode pipeline.
+ */
+
+importScripts('codec.js', 'store.js');
+
+const CACHE_NAME = 'velo-v3';
+
+// Encoded transform results, kept across versions and capped at TRANSFORM_CACHE_BYTES
+const TRANSFORM_CACHE = 'velo-transforms';
+const TRANSFORM_CACHE_BYTES = 128 * 1024 * 1024;
+const TRANSFORM_FRESH_MS = 60 * 1000; // Cached transforms older than this are revalidated against their source
+const TRANSFORM_CONCURRENCY = 2;      // Distinct misses fetched and encoded at once, the rest wait their turn
+
+// Proxy instrumentation for /metrics, same shape as metricsSnapshot() in app.js.
+// Counter and histogram keys may carry extra labels: 'requests_total{cache="hit"}', 'encode:webp'.
+// /metrics only exists inside this worker: it answers fetches from pages it controls, while an
+// external scraper such as Prometheus reaches the web server instead and gets its 404.
+const metrics = { histograms: {}, counters: {} };
+
+// Upper bounds (s) of the exported histogram buckets
+const METRICS_BUCKETS = [0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10];
+
+const APP_SHELL = [
+    './',
+    'index.html',
+    'style.css',
+    'app.js',
+    'codec.js',
+    'store.js',
+    'worker.js',
+    'velo.js',
+    'assets/VeloLogoText.svg',
+    'assets/fonts/Alfphabet.ttf',
+    'assets/js/jszip.min.js',
+    'https://cdn.jsdelivr.net/npm/bootstrap@5.3.0/dist/css/bootstrap.min.css'
+];
+
+self.addEventListener('install', (e) => {
+    // Entries are added one by one: a single missing asset must not abort the install
+    e.waitUntil(
+        caches.open(CACHE_NAME)
+            .then(cache => Promise.all(APP_SHELL.map(url => cache.add(new Request(url, { mode: 'cors' })).catch(() => {}))))
+            .then(() => self.skipWaiting())
+    );
+});
+
+self.addEventListener('activate', (e) => {
+    e.waitUntil(
+        caches.keys()
+            .then(keys => Promise.all(keys.filter(k => k !== CACHE_NAME && k !== TRANSFORM_CACHE).map(k => caches.delete(k))))
+            .then(() => self.clients.claim())
+    );
+});
+
+// Stale-while-revalidate: answer from cache immediately, refresh the entry in the background
+self.addEventListener('fetch', (e) => {
+    const req = e.request;
+    if (req.method !== 'GET') return;
+
+    const url = new URL(req.url);
+    if (url.href === new URL('metrics', self.registration.scope).href) {
+        e.respondWith(serveMetrics());
+        return;
+    }
+    const transform = parseTransform(url);
+    if (transform) {
+        e.respondWith(handleTransform(req, transform));
+        return;
+    }
+
+    const cacheable = url.origin === location.origin || APP_SHELL.includes(req.url);
+    if (!cacheable) return;
+
+    e.respondWith(caches.open(CACHE_NAME).then(async cache => {
+        const cached = await cache.match(req, { ignoreSearch: req.mode === 'navigate' });
+        const network = fetch(req).then(res => {
+            if (res.ok) cache.put(req, res.clone());
+            return res;
+        });
+
+        if (cached) {
+            e.waitUntil(network.catch(() => {}));
+            return cached;
+        }
+        // Offline navigation to a URL that was never cached: serve the shell
+        return network.catch(async () => (req.mode === 'navigate' && await cache.match('index.html')) || Response.error());
+    }));
+});
+
+// --- Transform Proxy ---
+
+// Options segment in front of a path relative to the scope: /w_800,h_600,f_webp,q_75/photos/a.jpg
+const TRANSFORM_OPTIONS = /^[a-z]_[a-z0-9]+(,[a-z]_[a-z0-9]+)*$/;
+const TRANSFORM_FORMATS = ['jpeg', 'webp', 'png'];
+
+// Identical requests arriving while one is looked up or encoded share its result: url -> Promise<{ entry, status }>
+const inflight = new Map();
+
+// Slots for source fetches and encodes, see withTransformSlot()
+const transformSlots = { running: 0, waiting: [] };
+
+// Cached transform url -> bytes, least recently used first (Map order). Rebuilt from the cache
+// in insertion order when the worker restarts, see loadTransformIndex().
+let transformIndex = null;
+
+// Resolves to { source, width, height, format, quality }, or null when the URL is not a transform
+function parseTransform(url) {
+    const scope = new URL(self.registration.scope);
+    if (url.origin !== scope.origin || !url.pathname.startsWith(scope.pathname)) return null;
+
+    const [segment, ...rest] = url.pathname.slice(scope.pathname.length).split('/');
+    if (rest.length === 0 || !TRANSFORM_OPTIONS.test(segment)) return null;
+
+    const source = new URL(rest.join('/'), scope);
+    if (!source.href.startsWith(scope.href)) return null;
+
+    const opts = { source: source.href, width: 0, height: 0, format: null, quality: 75 };
+    for (const [key, value] of segment.split(',').map(o => o.split('_'))) {
+        if (key === 'w') opts.width = parseInt(value) || 0;
+        else if (key === 'h') opts.height = parseInt(value) || 0;
+        else if (key === 'f') opts.format = value === 'jpg' ? 'jpeg' : value;
+        else if (key === 'q') opts.quality = Math.min(100, Math.max(1, parseInt(value) || 75));
+        else return null;
+    }
+    if (opts.format && !TRANSFORM_FORMATS.includes(opts.format)) return null;
+    return opts;
+}
+
+async function handleTransform(req, opts) {
+    const key = req.url.split('?')[0];
+    const start = performance.now();
+
+    // Registered before any await, so identical requests arriving meanwhile join this one
+    let work = inflight.get(key);
+    const coalesced = !!work;
+    if (!work) {
+        work = lookupOrTransform(key, opts);
+        inflight.set(key, work);
+        work.then(() => inflight.delete(key), () => inflight.delete(key));
+    }
+
+    try {
+        const { entry, status: outcome } = await work;
+        const status = coalesced ? 'coalesced' : outcome;
+        count(`proxy_requests_total{cache="${status}"}`);
+        recordValue(histogramFor(metrics.histograms, `request:${entry.blob.type.slice('image/'.length)}`), performance.now() - start);
+        return transformResponse(req, entry, status);
+    } catch (err) {
+        count(`proxy_errors_total{code="${err.status || 500}"}`);
+        return new Response(err.message || String(err), { status: err.status || 500, headers: { 'Content-Type': 'text/plain' } });
+    }
+}
+
+/**
+ * Resolves to { entry, status }, entry being { blob, etag, source: { etag, lastModified }, checkedAt }.
+ * status: 'hit' (fresh), 'revalidated' (source unchanged), 'stale' (source unreachable), 'store'
+ * (source changed or new, output found in the result store) or 'miss' (encoded).
+ */
+async function lookupOrTransform(key, opts) {
+    const cached = await cachedTransform(key);
+    if (cached && Date.now() - cached.checkedAt < TRANSFORM_FRESH_MS) return { entry: cached, status: 'hit' };
+
+    return withTransformSlot(async () => {
+        let res;
+        try {
+            res = await fetchSource(opts.source, cached && cached.source);
+        } catch (err) {
+            if (cached) return { entry: cached, status: 'stale' };
+            throw err;
+        }
+        if (cached && res.status === 304) {
+            const entry = { ...cached, checkedAt: Date.now() };
+            await cacheTransform(key, entry);
+            return { entry, status: 'revalidated' };
+        }
+        if (!res.ok) throw Object.assign(new Error(`Source responded ${res.status}`), { status: res.status });
+
+        const { entry, stored } = await transform(opts, res);
+        await cacheTransform(key, entry);
+        return { entry, status: stored ? 'store' : 'miss' };
+    });
+}
+
+// Runs fn once fewer than TRANSFORM_CONCURRENCY others hold a slot, so a burst of distinct URLs can't pile up decodes
+async function withTransformSlot(fn) {
+    while (transformSlots.running >= TRANSFORM_CONCURRENCY) await new Promise(resolve => transformSlots.waiting.push(resolve));
+    transformSlots.running++;
+    try {
+        return await fn();
+    } finally {
+        transformSlots.running--;
+        const next = transformSlots.waiting.shift();
+        if (next) next();
+        // The pool only pays off within a burst: canvases must not stay allocated in an idle worker
+        else if (transformSlots.running === 0) trimCanvasPool();
+    }
+}
+
+// Conditional when the validators of a cached output are known: an unchanged source answers 304
+function fetchSource(source, validators) {
+    const headers = {};
+    if (validators && validators.etag) headers['If-None-Match'] = validators.etag;
+    if (validators && validators.lastModified) headers['If-Modified-Since'] = validators.lastModified;
+    return fetch(source, { headers });
+}
+
+// Encodes a fetched source, or takes the output from the result store (store.js) when the page made it already
+async function transform({ source, width, height, format, quality }, res) {
+    const start = performance.now();
+    const validators = { etag: res.headers.get('ETag'), lastModified: res.headers.get('Last-Modified') };
+    const body = await res.blob();
+    if (!body.type.startsWith('image/')) throw Object.assign(new Error('Source is not an image'), { status: 415 });
+
+    const sourceFormat = body.type.slice('image/'.length);
+    format = format || (TRANSFORM_FORMATS.includes(sourceFormat) ? sourceFormat : 'jpeg');
+    const fetched = performance.now();
+    recordValue(histogramFor(metrics.histograms, `fetch:${format}`), fetched - start);
+    count('bytes_in_total', body.size);
+
+    // The store is the page's and only filled when the user keeps results there: the proxy never
+    // writes to it, and doesn't hash the source for a lookup while it's empty
+    const file = new File([body], source, { type: body.type, lastModified: Date.parse(validators.lastModified) || 0 });
+    const settings = { format, quality, effort: 'fast', width, height };
+    let blob = !(await storeEmpty()) && (await manifestGet(file, settings, { readOnly: true }) || {}).blob;
+    const stored = !!blob;
+    if (stored) {
+        count('store_hits_total');
+    } else {
+        const result = await encodeImage(file, settings);
+        blob = result.blob;
+        Object.entries(result.timings).forEach(([stage, ms]) => recordValue(histogramFor(metrics.histograms, `${stage}:${format}`), ms));
+    }
+    count('bytes_out_total', blob.size);
+
+    const etag = `"${(await sha256Hex(blob)).slice(0, 32)}"`;
+    return { entry: { blob, etag, source: validators, checkedAt: Date.now() }, stored };
+}
+
+// Conditional requests get a 304 when the client already holds this exact output
+function transformResponse(req, { blob, etag }, status) {
+    const headers = { 'ETag': etag, 'Cache-Control': 'no-cache', 'X-Velo-Cache': status };
+    const ifNoneMatch = req.headers.get('If-None-Match');
+    if (ifNoneMatch && (ifNoneMatch.trim() === '*' || ifNoneMatch.split(',').some(t => t.trim() === etag))) {
+        return new Response(null, { status: 304, headers });
+    }
+    return new Response(blob, { headers: { ...headers, 'Content-Type': blob.type, 'Content-Length': String(blob.size) } });
+}
+
+function loadTransformIndex() {
+    if (!transformIndex) {
+        transformIndex = caches.open(TRANSFORM_CACHE).then(async cache => {
+            const index = new Map();
+            for (const req of await cache.keys()) {
+                const res = await cache.match(req);
+                index.set(req.url, parseInt(res && res.headers.get('Content-Length')) || 0);
+            }
+            return index;
+        });
+    }
+    return transformIndex;
+}
+
+async function cachedTransform(key) {
+    const index = await loadTransformIndex();
+    if (!index.has(key)) return null;
+
+    const res = await (await caches.open(TRANSFORM_CACHE)).match(key);
+    if (!res) {
+        index.delete(key);
+        return null;
+    }
+    // Move to the most recently used end
+    const bytes = index.get(key);
+    index.delete(key);
+    index.set(key, bytes);
+    return {
+        blob: await res.blob(),
+        etag: res.headers.get('ETag'),
+        source: { etag: res.headers.get('X-Velo-Source-ETag'), lastModified: res.headers.get('X-Velo-Source-Last-Modified') },
+        checkedAt: parseInt(res.headers.get('X-Velo-Checked-At')) || 0
+    };
+}
+
+// The source's validators and the time they were last confirmed travel with the output as headers
+async function cacheTransform(key, { blob, etag, source, checkedAt }) {
+    const [index, cache] = await Promise.all([loadTransformIndex(), caches.open(TRANSFORM_CACHE)]);
+    const headers = { 'Content-Type': blob.type, 'Content-Length': String(blob.size), 'ETag': etag, 'X-Velo-Checked-At': String(checkedAt) };
+    if (source.etag) headers['X-Velo-Source-ETag'] = source.etag;
+    if (source.lastModified) headers['X-Velo-Source-Last-Modified'] = source.lastModified;
+    await cache.put(key, new Response(blob, { headers }));
+    index.delete(key);
+    index.set(key, blob.size);
+
+    let total = 0;
+    index.forEach(bytes => { total += bytes; });
+    for (const [oldest, bytes] of index) {
+        if (total <= TRANSFORM_CACHE_BYTES) break;
+        index.delete(oldest);
+        total -= bytes;
+        await cache.delete(oldest);
+    }
+}
+
+// --- Metrics ---
+
+function count(key, n = 1) {
+    metrics.counters[key] = (metrics.counters[key] || 0) + n;
+}
+
+function proxySnapshot() {
+    const pool = canvasPoolStats();
+    let cacheBytes = 0;
+    return (transformIndex || Promise.resolve(new Map())).then(index => {
+        index.forEach(bytes => { cacheBytes += bytes; });
+        return {
+            histograms: metrics.histograms,
+            counters: metrics.counters,
+            gauges: {
+                proxy_inflight: inflight.size,
+                proxy_waiting: transformSlots.waiting.length,
+                proxy_cache_bytes: cacheBytes,
+                canvas_pool_bytes: pool.liveBytes + pool.pooledBytes
+            }
+        };
+    });
+}
+
+// Pages that answer velo:metrics (see registerServiceWorker in app.js); others, like bench.html, are not asked
+const METRICS_PAGES = ['', 'index.html'];
+
+function isMetricsPage(client) {
+    const scope = new URL(self.registration.scope);
+    const url = new URL(client.url);
+    return url.origin === scope.origin && METRICS_PAGES.some(page => url.pathname === new URL(page, scope).pathname);
+}
+
+// Asks an open page for its metricsSnapshot(); pages that don't answer in time (frozen tabs) are left out
+function pageSnapshot(client) {
+    return new Promise(resolve => {
+        const channel = new MessageChannel();
+        const timer = setTimeout(() => resolve(null), 250);
+        channel.port1.onmessage = e => {
+            clearTimeout(timer);
+            resolve(e.data);
+        };
+        client.postMessage({ type: 'velo:metrics' }, [channel.port2]);
+    });
+}
+
+function mergeSnapshots(snapshots) {
+    const merged = { histograms: {}, counters: {}, gauges: {} };
+    for (const s of snapshots) {
+        Object.entries(s.histograms).forEach(([k, h]) => mergeHistogram(histogramFor(merged.histograms, k), h));
+        ['counters', 'gauges'].forEach(kind => Object.entries(s[kind]).forEach(([k, v]) => {
+            merged[kind][k] = (merged[kind][k] || 0) + v;
+        }));
+    }
+    return merged;
+}
+
+// Prometheus text exposition of the proxy and all open pages, told apart by the `source` label
+async function serveMetrics() {
+    const windows = await self.clients.matchAll({ type: 'window' });
+    const pages = (await Promise.all(windows.filter(isMetricsPage).map(pageSnapshot))).filter(Boolean);
+    const sources = { page: mergeSnapshots(pages), proxy: await proxySnapshot() };
+
+    const families = new Map(); // metric name -> { type, lines }
+    const add = (name, type, labels, value, suffix = '') => {
+        if (!families.has(name)) families.set(name, { type, lines: [] });
+        families.get(name).lines.push(`velo_${name}${suffix}{${labels}} ${value}`);
+    };
+    const split = key => {
+        const i = key.indexOf('{');
+        return i < 0 ? [key, ''] : [key.slice(0, i), ',' + key.slice(i + 1, -1)];
+    };
+
+    for (const [source, snapshot] of Object.entries(sources)) {
+        const base = `source="${source}"`;
+        Object.entries(snapshot.counters).forEach(([key, v]) => { const [name, labels] = split(key); add(name, 'counter', base + labels, v); });
+        Object.entries(snapshot.gauges).forEach(([key, v]) => { const [name, labels] = split(key); add(name, 'gauge', base + labels, v); });
+
+        for (const [key, h] of Object.entries(snapshot.histograms)) {
+            const [stage, format] = key.split(':');
+            const labels = `${base},stage="${stage}",format="${format}"`;
+            // A log bucket straddling a bound is counted above it, so quantiles err on the slow side
+            let i = 0, cumulative = 0;
+            for (const le of METRICS_BUCKETS) {
+                while (i < HISTOGRAM_BUCKETS && bucketUpperBound(i) <= le * 1000) cumulative += h.counts[i++];
+                add('stage_seconds', 'histogram', `${labels},le="${le}"`, cumulative, '_bucket');
+            }
+            add('stage_seconds', 'histogram', `${labels},le="+Inf"`, h.count, '_bucket');
+            add('stage_seconds', 'histogram', labels, h.sum / 1000, '_sum');
+            add('stage_seconds', 'histogram', labels, h.count, '_count');
+        }
+    }
+
+    let body = '';
+    for (const [name, { type, lines }] of families) {
+        body += `# TYPE velo_${name} ${type}\n` + lines.join('\n') + '\n';
+    }
+    return new Response(body, { headers: { 'Content-Type': 'text/plain; version=0.0.4', 'Cache-Control': 'no-store' } });
+}
@@ -0,0 +1,364 @@
+/**
+ * VELO - Library
+ * Headless ES module over the compression engine, free of DOM and UI state:
+ *   import { optimize, optimizeStream } from './velo.js';
+ *   const result = await optimize(file, { format: 'webp', quality: 75 });
+ *   for await (const r of optimizeStream(files, { format: 'webp' })) save(r.name, r.blob);
+ * In browsers jobs run on worker.js encoder workers, or on the calling thread (codec.js must be loaded)
+ * where workers can't encode. Node has no canvas: pass an `encode` hook backed by an image library
+ * to createVelo(). The app (app.js) and the bench (bench.js) are clients of this module and run on its
+ * worker pool, see createWorkerPool().
+ */
+
+const FORMATS = ['jpeg', 'webp', 'png'];
+
+// Jobs in flight per worker: the running one plus one decoding ahead
+const WORKER_QUEUE_DEPTH = 2;
+
+// Crash isolation, see createWorkerPool()
+const MAX_JOB_ATTEMPTS = 2;
+const JOB_TIMEOUT_MS = 120 * 1000;
+const WATCHDOG_INTERVAL_MS = 5000;
+
+// Encodes on the calling thread; once they stop for this long its pooled canvases are freed, as in worker.js
+const CALLING_THREAD_TRIM_MS = 2000;
+const callingThread = { running: 0, idleTrim: null };
+
+/**
+ * Result of optimize():
+ *   { name, blob, format, width, height, size, originalSize, savings, timings, cached }
+ * plus whatever else the encode hook returned. `name` is the output file name, `savings` in percent.
+ */
+
+/**
+ * Creates an engine. Options:
+ *   workers   size of the built-in worker pool (default: hardwareConcurrency - 1), 0 encodes on the calling thread
+ *   workerUrl worker.js location (default: next to this module)
+ *   pool      a createWorkerPool() to run on instead of a built-in one, left running by terminate()
+ *   encode    (file, settings) -> Promise<{ blob, width, height, timings? }> replacing the pool
+ *   cache     { get(file, settings), put(file, settings, result) } consulted before encoding
+ */
+export function createVelo({ workers, workerUrl, pool: sharedPool, encode, cache } = {}) {
+    let pool = sharedPool || null;
+    const run = encode || ((file, settings) => {
+        if (pool || (workers !== 0 && canUseWorkers())) {
+            pool = pool || createWorkerPool({ size: workers, url: workerUrl });
+            return pool.run({ file, ...settings });
+        }
+        if (typeof globalThis.encodeImage === 'function') return encodeOnCallingThread(file, settings);
+        throw new Error('VELO: no encoder available, pass createVelo({ encode })');
+    });
+
+    async function optimize(input, options = {}) {
+        const file = toFile(input);
+        const settings = normalizeSettings(options, file);
+
+        let result = cache ? await cache.get(file, settings) : null;
+        const cached = !!result;
+        if (!result) {
+            result = await run(file, settings);
+            if (cache) cache.put(file, settings, result);
+        }
+
+        const { blob } = result;
+        return {
+            ...result,
+            name: outputName(file.name, settings.format),
+            format: settings.format,
+            size: blob.size,
+            originalSize: file.size,
+            savings: file.size ? 100 - (blob.size / file.size) * 100 : 0,
+            timings: result.timings || {},
+            cached
+        };
+    }
+
+    /**
+     * Optimizes an array or (async) iterable of files and yields results in completion order.
+     * At most `concurrency` files are read and in flight at once; a failed file yields { name, error }.
+     */
+    async function* optimizeStream(inputs, options = {}, { concurrency } = {}) {
+        const limit = concurrency || (encode ? 4 : pool ? pool.concurrency : (workers || defaultWorkers()) * WORKER_QUEUE_DEPTH);
+        const running = new Set(); // Promises settling to { promise: itself, result }
+        const start = (input, index) => {
+            const promise = optimize(input, options)
+                .catch(err => ({ name: input && input.name, error: err.message || String(err) }))
+                .then(result => ({ promise, result: { ...result, index } }));
+            running.add(promise);
+        };
+
+        let index = 0;
+        for await (const input of inputs) {
+            start(input, index++);
+            if (running.size >= limit) {
+                const { promise, result } = await Promise.race(running);
+                running.delete(promise);
+                yield result;
+            }
+        }
+        while (running.size > 0) {
+            const { promise, result } = await Promise.race(running);
+            running.delete(promise);
+            yield result;
+        }
+    }
+
+    // Optimizes every file, resolves to the results in input order; onResult sees each as it completes
+    async function optimizeAll(inputs, options = {}, { concurrency, onResult } = {}) {
+        const results = [];
+        for await (const result of optimizeStream(inputs, options, { concurrency })) {
+            results[result.index] = result;
+            if (onResult) onResult(result);
+        }
+        return results;
+    }
+
+    function terminate() {
+        if (pool && pool !== sharedPool) pool.terminate();
+        pool = sharedPool || null;
+    }
+
+    return { optimize, optimizeStream, optimizeAll, terminate };
+}
+
+async function encodeOnCallingThread(file, settings) {
+    clearTimeout(callingThread.idleTrim);
+    callingThread.running++;
+    try {
+        return await globalThis.encodeImage(file, settings);
+    } finally {
+        if (--callingThread.running === 0 && typeof globalThis.trimCanvasPool === 'function') {
+            callingThread.idleTrim = setTimeout(() => globalThis.trimCanvasPool(), CALLING_THREAD_TRIM_MS);
+        }
+    }
+}
+
+// Shared engine behind the module-level shortcuts, created on first use
+let defaultEngine = null;
+const engine = () => defaultEngine || (defaultEngine = createVelo());
+
+export const optimize = (file, options) => engine().optimize(file, options);
+export const optimizeStream = (files, options, config) => engine().optimizeStream(files, options, config);
+export const optimizeAll = (files, options, config) => engine().optimizeAll(files, options, config);
+
+// "photo.png" + webp -> "photo.webp"
+export function outputName(name, format) {
+    const ext = format === 'jpeg' ? 'jpg' : format;
+    const dot = name.lastIndexOf('.');
+    return (dot > 0 ? name.substring(0, dot) : name) + '.' + ext;
+}
+
+/**
+ * Packs results ({ name, blob }) into a ZIP Blob. JSZip is taken from the global scope unless given.
+ * Images are already compressed: storing skips a deflate pass that would gain next to nothing.
+ */
+export async function zipResults(results, JSZipImpl = globalThis.JSZip) {
+    if (!JSZipImpl) throw new Error('VELO: JSZip is not loaded');
+    const zip = new JSZipImpl();
+    results.forEach(r => { if (r.blob) zip.file(r.name, r.blob); });
+    return zip.generateAsync({ type: 'blob', compression: 'STORE' });
+}
+
+// Fills in defaults: jpeg, quality 75, fast effort, no size bound
+export function normalizeSettings({ format, quality, effort, width, height, priority } = {}, file = null) {
+    format = format === 'jpg' ? 'jpeg' : format;
+    if (!FORMATS.includes(format)) {
+        const source = file && file.type ? file.type.slice('image/'.length) : null;
+        format = FORMATS.includes(source) ? source : 'jpeg';
+    }
+    return {
+        format,
+        quality: Math.min(100, Math.max(1, parseInt(quality) || 75)),
+        effort: ['fast', 'balanced', 'max'].includes(effort) ? effort : 'fast',
+        width: parseInt(width) || 0,
+        height: parseInt(height) || 0,
+        priority: priority || 0
+    };
+}
+
+// Accepts File/Blob, ArrayBuffer and typed arrays (e.g. a Node Buffer)
+function toFile(input) {
+    if (typeof File !== 'undefined' && input instanceof File) return input;
+    if (input instanceof Blob) return new File([input], 'image', { type: input.type });
+    if (input instanceof ArrayBuffer || ArrayBuffer.isView(input)) return new File([input], 'image');
+    throw new TypeError('VELO: expected a File, Blob or byte array');
+}
+
+function canUseWorkers() {
+    return typeof Worker !== 'undefined' && typeof OffscreenCanvas !== 'undefined';
+}
+
+function defaultWorkers() {
+    const cores = (typeof navigator !== 'undefined' && navigator.hardwareConcurrency) || 2;
+    return Math.max(1, cores - 1);
+}
+
+// --- Worker Pool ---
+
+/**
+ * Scheduler-aware pool over worker.js:
+ *  - Each worker holds up to WORKER_QUEUE_DEPTH jobs, the running one and one decoding ahead. Jobs beyond
+ *    that wait here and are posted lowest `priority` first, in submission order within a priority.
+ *  - Work stealing: a worker that ran dry with nothing waiting takes the least urgent not-yet-started job
+ *    of the most loaded worker, so one big image doesn't hold up the job queued behind it.
+ *  - Crash isolation: a worker that threw, crashed or ran one job past jobTimeout is replaced. The job it
+ *    was running and the one decoding ahead are both blamed, since either may have caused it, and are
+ *    retried up to maxAttempts in total before they fail; its other jobs are queued again unchanged.
+ *  - Messages sent with broadcast() (e.g. encoder warmups) are replayed to replacement workers.
+ * run(job) resolves to the worker's result plus `tid`, the 1-based worker number.
+ */
+export function createWorkerPool({ size, url, jobTimeout = JOB_TIMEOUT_MS, maxAttempts = MAX_JOB_ATTEMPTS } = {}) {
+    size = size || defaultWorkers();
+    url = url || new URL('./worker.js', import.meta.url);
+
+    const waiting = [];             // Messages not posted to a worker yet
+    const callbacks = new Map();    // job id -> { resolve, reject }
+    const broadcasts = [];
+    const pools = {};               // tid -> latest canvasPoolStats() of that worker
+    const counters = { busyMs: 0, restarts: 0, failedJobs: 0 };
+    let nextId = 1;
+
+    const spawn = (tid) => {
+        const slot = {
+            worker: new Worker(url),
+            tid,
+            busy: 0,
+            busySince: 0,
+            jobs: new Map(),    // Posted and not finished: id -> message, for re-queueing after a crash
+            current: null,      // { id, since } of the job the worker reported as started
+            decoding: null,     // id of the job the worker reported as decoding ahead of `current`
+            stealing: null      // Thief waiting for this worker's answer to 'steal'
+        };
+        slot.worker.onmessage = (e) => onMessage(slot, e.data);
+        slot.worker.onerror = (e) => {
+            e.preventDefault();
+            restart(slot, e.message || 'worker error');
+        };
+        slot.worker.postMessage({ type: 'pool', threads: size });
+        broadcasts.forEach(msg => slot.worker.postMessage(msg));
+        return slot;
+    };
+    const slots = Array.from({ length: size }, (_, i) => spawn(i + 1));
+
+    // Watchdog for hung decoders/encoders
+    const watchdog = setInterval(() => {
+        const now = performance.now();
+        slots.forEach(slot => {
+            if (slot.current && now - slot.current.since > jobTimeout) restart(slot, 'timeout');
+        });
+    }, WATCHDOG_INTERVAL_MS);
+
+    function onMessage(slot, data) {
+        switch (data.type) {
+            case 'stolen': return onStolen(slot, data.job);
+            case 'started':
+                slot.current = { id: data.id, since: performance.now() };
+                if (slot.decoding === data.id) slot.decoding = null;
+                return;
+            case 'decoding':
+                slot.decoding = data.id;
+                return;
+            case 'pool': // Trimmed while idle
+                pools[slot.tid] = data.pool;
+                return;
+        }
+
+        slot.jobs.delete(data.id);
+        if (slot.current && slot.current.id === data.id) slot.current = null;
+        if (slot.decoding === data.id) slot.decoding = null;
+        if (--slot.busy === 0) counters.busyMs += performance.now() - slot.busySince;
+        if (data.pool) pools[slot.tid] = data.pool;
+
+        const cb = callbacks.get(data.id);
+        callbacks.delete(data.id);
+        if (cb) data.error ? cb.reject(new Error(data.error)) : cb.resolve({ ...data, tid: slot.tid });
+        dispatch();
+        if (slot.busy === 0) stealFor(slot);
+    }
+
+    function dispatch() {
+        while (waiting.length > 0) {
+            const slot = slots.reduce((a, b) => b.busy < a.busy ? b : a);
+            if (slot.busy >= WORKER_QUEUE_DEPTH) return;
+            let next = 0;
+            waiting.forEach((msg, i) => { if ((msg.priority || 0) < (waiting[next].priority || 0)) next = i; });
+            post(slot, waiting.splice(next, 1)[0]);
+        }
+    }
+
+    function post(slot, msg) {
+        slot.jobs.set(msg.id, msg);
+        if (slot.busy++ === 0) slot.busySince = performance.now();
+        slot.worker.postMessage(msg);
+    }
+
+    function restart(slot, reason) {
+        slot.worker.terminate();
+        if (slot.busy > 0) counters.busyMs += performance.now() - slot.busySince;
+        counters.restarts++;
+        console.warn(`VELO: worker ${slot.tid} restarted (${reason})`);
+        slots[slots.indexOf(slot)] = spawn(slot.tid);
+
+        const blamed = [slot.current && slot.current.id, slot.decoding].filter(id => id !== null);
+        slot.jobs.forEach(msg => {
+            if (blamed.includes(msg.id) && (msg.attempts = (msg.attempts || 0) + 1) >= maxAttempts) {
+                counters.failedJobs++;
+                const cb = callbacks.get(msg.id);
+                callbacks.delete(msg.id);
+                if (cb) cb.reject(new Error(`Worker failed on this image (${reason})`));
+                return;
+            }
+            waiting.push(msg);
+        });
+        dispatch();
+    }
+
+    function stealFor(thief) {
+        if (waiting.length > 0) return;
+        const victim = slots.reduce((a, b) => b.busy > a.busy ? b : a);
+        if (victim === thief || victim.busy < 2 || victim.stealing) return;
+        victim.stealing = thief;
+        victim.worker.postMessage({ type: 'steal' });
+    }
+
+    function onStolen(victim, job) {
+        const thief = victim.stealing;
+        victim.stealing = null;
+        if (!job) return; // Started before the request arrived
+
+        victim.jobs.delete(job.id);
+        if (victim.decoding === job.id) victim.decoding = null;
+        victim.busy--;
+        post(thief.busy === 0 && slots.includes(thief) ? thief : victim, job);
+    }
+
+    return {
+        size,
+        concurrency: size * WORKER_QUEUE_DEPTH, // Jobs the workers hold at once
+        run(job) {
+            const id = nextId++;
+            return new Promise((resolve, reject) => {
+                callbacks.set(id, { resolve, reject });
+                waiting.push({ ...job, id });
+                dispatch();
+            });
+        },
+        broadcast(msg) {
+            broadcasts.push(msg);
+            slots.forEach(s => s.worker.postMessage(msg));
+        },
+        // busyMs sums the time workers held at least one job, including jobs still running
+        stats() {
+            const now = performance.now();
+            const busyNow = slots.reduce((sum, s) => sum + (s.busy > 0 ? now - s.busySince : 0), 0);
+            return { workers: size, waiting: waiting.length, busyMs: counters.busyMs + busyNow, restarts: counters.restarts, failedJobs: counters.failedJobs, pools: { ...pools } };
+        },
+        terminate() {
+            clearInterval(watchdog);
+            slots.forEach(s => s.worker.terminate());
+            callbacks.forEach(cb => cb.reject(new Error('Pool terminated')));
+            callbacks.clear();
+            waiting.length = 0;
+        }
+    };
+}
@@ -0,0 +1,117 @@
+/**
+ * VELO - Encoder Worker
+ * Runs encodeImage off the main thread. Jobs are queued in a local deque and encoded one at a time,
+ * lowest priority value first, with the next job decoding meanwhile (see drain):
+ *   in:  { id, file, format, quality, effort, priority, width?, height? }
+ *   out: { id, blob, width, height, timings, starts, pool } or { id, error }, pool being canvasPoolStats()
+ * Every job is announced with { type: 'started', id } when it begins, and a job decoding ahead with
+ * { type: 'decoding', id }, so the page knows which jobs to blame if the worker crashes or hangs.
+ * Other messages:
+ *   { type: 'warmup', format }  initializes an encoder ahead of the first job (no reply)
+ *   { type: 'metric', id, original, encoded }  compares two images, out { id, psnr, ssim }
+ *   { type: 'steal' }  gives back the least urgent job that hasn't started, even one decoding ahead,
+ *                      out { type: 'stolen', job } (job may be null)
+ *   { type: 'pool', threads }  sizes this worker's canvas pool to its share of a pool of `threads` (no reply)
+ * A worker left idle for POOL_IDLE_TRIM_MS frees its pooled canvases and posts { type: 'pool', pool }.
+ */
+
+importScripts('codec.js');
+
+const POOL_IDLE_TRIM_MS = 2000;
+
+const deque = [];
+let draining = false;
+let ahead = null; // { msg, decoding } of the next job, decoding while the current one encodes
+let idleTrim = null;
+
+self.onmessage = (e) => {
+    const msg = e.data;
+    switch (msg.type) {
+        case 'warmup':
+            probeEncoder(msg.format).catch(() => {});
+            break;
+        case 'pool':
+            setCanvasPoolThreads(msg.threads);
+            break;
+        case 'steal':
+            self.postMessage({ type: 'stolen', job: stealJob() });
+            break;
+        default:
+            clearTimeout(idleTrim);
+            deque.push(msg);
+            // A job arriving while another one runs starts decoding right away
+            if (draining) prefetch();
+            else drain();
+    }
+};
+
+/**
+ * Runs queued jobs as a two-stage pipeline: while one job encodes, the next one is already decoding.
+ * At most one decoded bitmap waits ahead, which bounds memory on huge images.
+ */
+async function drain() {
+    if (draining) return;
+    draining = true;
+    while (deque.length > 0 || ahead) {
+        const current = ahead || { msg: takeNext() };
+        ahead = null;
+        prefetch();
+        await run(current.msg, current.decoding);
+    }
+    draining = false;
+    // Canvases pooled for a batch would otherwise stay allocated until the next one
+    idleTrim = setTimeout(() => {
+        trimCanvasPool();
+        self.postMessage({ type: 'pool', pool: canvasPoolStats() });
+    }, POOL_IDLE_TRIM_MS);
+}
+
+function prefetch() {
+    if (ahead || deque.length === 0) return;
+    const msg = takeNext();
+    if (msg.type === 'metric') {
+        ahead = { msg, decoding: null };
+        return;
+    }
+    self.postMessage({ type: 'decoding', id: msg.id });
+    ahead = { msg, decoding: startDecode(msg.file) };
+}
+
+/**
+ * Gives up the least urgent job that hasn't started. With the page keeping two jobs per worker the
+ * second one is usually already decoding ahead: it goes too, its bitmap closed once the decode settles.
+ */
+function stealJob() {
+    if (deque.length > 0) {
+        let worst = 0;
+        deque.forEach((job, i) => { if ((job.priority || 0) >= (deque[worst].priority || 0)) worst = i; });
+        return deque.splice(worst, 1)[0];
+    }
+    if (!ahead || ahead.msg.type === 'metric') return null;
+    const { msg, decoding } = ahead;
+    ahead = null;
+    decoding.then(({ bitmap }) => bitmap.close && bitmap.close(), () => {});
+    return msg;
+}
+
+function takeNext() {
+    let best = 0;
+    deque.forEach((job, i) => { if ((job.priority || 0) < (deque[best].priority || 0)) best = i; });
+    return deque.splice(best, 1)[0];
+}
+
+async function run(msg, decoding) {
+    const { id, file, format, quality, effort, width, height } = msg;
+    self.postMessage({ type: 'started', id });
+    try {
+        if (msg.type === 'metric') {
+            const a = await decodePixels(msg.original), b = await decodePixels(msg.encoded);
+            self.postMessage({ id, psnr: psnr(a, b), ssim: ssim(a, b) });
+            return;
+        }
+        const result = await encodeImage(file, { format, quality, effort, width, height }, decoding || startDecode(file));
+        self.postMessage({ id, ...result, pool: canvasPoolStats() });
+    } catch (err) {
+        self.postMessage({ id, error: err.message || String(err) });
+    }
+}